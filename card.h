@@ -5,6 +5,33 @@
 #include <vector>
 #include "tyrant.h"
 
+// A run of skills stored elsewhere: in Cards::sim_skills, or in a std::vector.
+struct SkillList
+{
+    typedef const SkillSpec* iterator;
+    typedef const SkillSpec* const_iterator;
+    const SkillSpec* m_begin;
+    const SkillSpec* m_end;
+
+    SkillList() : m_begin(nullptr), m_end(nullptr) {}
+    SkillList(const SkillSpec* begin_, const SkillSpec* end_) : m_begin(begin_), m_end(end_) {}
+    SkillList(const std::vector<SkillSpec>& skills) : m_begin(skills.data()), m_end(skills.data() + skills.size()) {}
+    const SkillSpec* begin() const { return(m_begin); }
+    const SkillSpec* end() const { return(m_end); }
+    unsigned size() const { return(m_end - m_begin); }
+    bool empty() const { return(m_begin == m_end); }
+};
+
+// The skills of a card with a battleground effect applied, see compile_skills().
+struct SkillProgram
+{
+    std::vector<SkillSpec> skills;
+    std::vector<SkillSpec> skills_on_death;
+    bool battle_dependent; // m_skills apply instead when may_change_skill() says the effect does not
+};
+
+struct SimCard;
+
 class Card
 {
 public:
@@ -67,20 +94,21 @@ public:
         m_valor(0),
         m_wall(false),
         m_skills(),
+        m_sim_card(nullptr),
         m_type(CardType::assault)
     {
     }
 
     void add_skill(Skill v1, unsigned v2, Faction v3, bool v4)
-    { m_skills.push_back(std::make_tuple(v1, v2, v3, v4, SkillMod::on_activate)); }
+    { m_skills.emplace_back(v1, v2, v3, v4, SkillMod::on_activate); }
     void add_played_skill(Skill v1, unsigned v2, Faction v3, bool v4)
-    { m_skills_on_play.push_back(std::make_tuple(v1, v2, v3, v4, SkillMod::on_play)); }
+    { m_skills_on_play.emplace_back(v1, v2, v3, v4, SkillMod::on_play); }
     void add_died_skill(Skill v1, unsigned v2, Faction v3, bool v4)
-    { m_skills_on_death.push_back(std::make_tuple(v1, v2, v3, v4, SkillMod::on_death)); }
+    { m_skills_on_death.emplace_back(v1, v2, v3, v4, SkillMod::on_death); }
     void add_attacked_skill(Skill v1, unsigned v2, Faction v3, bool v4)
-    { m_skills_on_attacked.push_back(std::make_tuple(v1, v2, v3, v4, SkillMod::on_attacked)); }
+    { m_skills_on_attacked.emplace_back(v1, v2, v3, v4, SkillMod::on_attacked); }
     void add_kill_skill(Skill v1, unsigned v2, Faction v3, bool v4)
-    { m_skills_on_kill.push_back(std::make_tuple(v1, v2, v3, v4, SkillMod::on_kill)); }
+    { m_skills_on_kill.emplace_back(v1, v2, v3, v4, SkillMod::on_kill); }
 
     unsigned m_antiair;
     unsigned m_armored;
@@ -149,7 +177,72 @@ public:
     std::vector<SkillSpec> m_skills_on_death;
     std::vector<SkillSpec> m_skills_on_attacked;
     std::vector<SkillSpec> m_skills_on_kill;
+    const SimCard* m_sim_card; // what the battles read of this card, see Cards::organize()
     CardType::CardType m_type;
 };
 
+// What the battles read of a card: the stats, the skill flags and the skills, packed together so that
+// a board of cards stays within a few cache lines. Built by Cards::organize(); the rest is in m_info.
+struct SimCard
+{
+    SimCard(const Card& card, std::vector<SkillSpec>& skills);
+
+    const Card* m_info;
+    SkillList m_skills;
+    SkillList m_skills_on_play;
+    SkillList m_skills_on_death;
+    SkillList m_skills_on_attacked;
+    SkillList m_skills_on_kill;
+    std::vector<SkillProgram> m_skill_programs; // one per battleground effect of the run
+    unsigned m_id;
+    CardType::CardType m_type : 8;
+    Faction m_faction : 8;
+    uint16_t m_antiair;
+    uint16_t m_armored;
+    uint16_t m_attack;
+    uint16_t m_berserk;
+    uint16_t m_berserk_oa;
+    uint16_t m_burst;
+    uint16_t m_corrosive;
+    uint16_t m_counter;
+    uint16_t m_crush;
+    uint16_t m_delay;
+    uint16_t m_enfeeble;
+    uint16_t m_evade;
+    uint16_t m_flurry;
+    uint16_t m_heal;
+    uint16_t m_health;
+    uint16_t m_inhibit;
+    uint16_t m_jam;
+    uint16_t m_leech;
+    uint16_t m_legion;
+    uint16_t m_pierce;
+    uint16_t m_poison;
+    uint16_t m_poison_oa;
+    uint16_t m_rally;
+    uint16_t m_regenerate;
+    uint16_t m_siphon;
+    uint16_t m_strike;
+    uint16_t m_valor;
+    bool m_blitz : 1;
+    bool m_disease : 1;
+    bool m_disease_oa : 1;
+    bool m_emulate : 1;
+    bool m_fear : 1;
+    bool m_flying : 1;
+    bool m_fusion : 1;
+    bool m_immobilize : 1;
+    bool m_intercept : 1;
+    bool m_payback : 1;
+    bool m_phase : 1;
+    bool m_refresh : 1;
+    bool m_split : 1;
+    bool m_stun : 1;
+    bool m_sunder : 1;
+    bool m_sunder_oa : 1;
+    bool m_swipe : 1;
+    bool m_tribute : 1;
+    bool m_wall : 1;
+};
+
 #endif
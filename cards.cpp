@@ -1,6 +1,7 @@
 #include "cards.h"
 
 #include <boost/tokenizer.hpp>
+#include <cassert>
 #include <map>
 #include <sstream>
 #include <stdexcept>
@@ -146,4 +147,111 @@ void Cards::organize()
             proto_card->m_upgraded_id = card->m_id;
         }
     }
+    // The records of the battles, in one array, with the skills of all the cards in another one.
+    // Both are sized beforehand: the records point into the skills, and the cards point to their records.
+    size_t num_skills(0);
+    for(Card* card: cards)
+    {
+        num_skills += card->m_skills.size() + card->m_skills_on_play.size() + card->m_skills_on_death.size() +
+            card->m_skills_on_attacked.size() + card->m_skills_on_kill.size();
+    }
+    sim_skills.clear();
+    sim_skills.reserve(num_skills);
+    sim_cards.clear();
+    sim_cards.reserve(cards.size());
+    unsigned max_id(0);
+    for(Card* card: cards)
+    {
+        sim_cards.emplace_back(*card, sim_skills);
+        card->m_sim_card = &sim_cards.back();
+        max_id = std::max(max_id, card->m_id);
+    }
+    sim_cards_by_id.assign(max_id + 1, nullptr);
+    for(const SimCard& sim_card: sim_cards)
+    {
+        sim_cards_by_id[sim_card.m_id] = &sim_card;
+    }
+    // A random summon of a faction is one draw from its pool, in the order of player_assaults.
+    for(auto& pool: summon_pools)
+    {
+        pool.clear();
+    }
+    for(const Card* card: player_assaults)
+    {
+        summon_pools[allfactions].push_back(card->m_sim_card);
+        if(card->m_faction != allfactions)
+        {
+            summon_pools[card->m_faction].push_back(card->m_sim_card);
+        }
+    }
 }
+
+//------------------------------------------------------------------------------
+// Append skills to the storage of the skills of all the cards, which does not grow past its reserved capacity.
+SkillList append_skills(std::vector<SkillSpec>& storage, const std::vector<SkillSpec>& skills)
+{
+    assert(storage.size() + skills.size() <= storage.capacity());
+    size_t first(storage.size());
+    storage.insert(storage.end(), skills.begin(), skills.end());
+    return(SkillList(storage.data() + first, storage.data() + storage.size()));
+}
+
+SimCard::SimCard(const Card& card, std::vector<SkillSpec>& skills) :
+    m_info(&card),
+    m_skills(append_skills(skills, card.m_skills)),
+    m_skills_on_play(append_skills(skills, card.m_skills_on_play)),
+    m_skills_on_death(append_skills(skills, card.m_skills_on_death)),
+    m_skills_on_attacked(append_skills(skills, card.m_skills_on_attacked)),
+    m_skills_on_kill(append_skills(skills, card.m_skills_on_kill)),
+    m_id(card.m_id),
+    m_type(card.m_type),
+    m_faction(card.m_faction),
+    m_antiair(card.m_antiair),
+    m_armored(card.m_armored),
+    m_attack(card.m_attack),
+    m_berserk(card.m_berserk),
+    m_berserk_oa(card.m_berserk_oa),
+    m_burst(card.m_burst),
+    m_corrosive(card.m_corrosive),
+    m_counter(card.m_counter),
+    m_crush(card.m_crush),
+    m_delay(card.m_delay),
+    m_enfeeble(card.m_enfeeble),
+    m_evade(card.m_evade),
+    m_flurry(card.m_flurry),
+    m_heal(card.m_heal),
+    m_health(card.m_health),
+    m_inhibit(card.m_inhibit),
+    m_jam(card.m_jam),
+    m_leech(card.m_leech),
+    m_legion(card.m_legion),
+    m_pierce(card.m_pierce),
+    m_poison(card.m_poison),
+    m_poison_oa(card.m_poison_oa),
+    m_rally(card.m_rally),
+    m_regenerate(card.m_regenerate),
+    m_siphon(card.m_siphon),
+    m_strike(card.m_strike),
+    m_valor(card.m_valor),
+    m_blitz(card.m_blitz),
+    m_disease(card.m_disease),
+    m_disease_oa(card.m_disease_oa),
+    m_emulate(card.m_emulate),
+    m_fear(card.m_fear),
+    m_flying(card.m_flying),
+    m_fusion(card.m_fusion),
+    m_immobilize(card.m_immobilize),
+    m_intercept(card.m_intercept),
+    m_payback(card.m_payback),
+    m_phase(card.m_phase > 0),
+    m_refresh(card.m_refresh),
+    m_split(card.m_split),
+    m_stun(card.m_stun),
+    m_sunder(card.m_sunder),
+    m_sunder_oa(card.m_sunder_oa),
+    m_swipe(card.m_swipe),
+    m_tribute(card.m_tribute),
+    m_wall(card.m_wall)
+{
+}
+
@@ -1,11 +1,12 @@
 #ifndef CARDS_H_INCLUDED
 #define CARDS_H_INCLUDED
 
+#include <array>
 #include <map>
 #include <string>
 #include <vector>
 
-class Card;
+#include "card.h"
 
 class Cards
 {
@@ -21,6 +22,10 @@ public:
     std::vector<Card*> player_structures;
     std::vector<Card*> player_actions;
     std::map<std::string, std::string> player_cards_abbr;
+    std::vector<SimCard> sim_cards; // what the battles read of the cards, see SimCard
+    std::vector<SkillSpec> sim_skills; // the skills of sim_cards
+    std::vector<const SimCard*> sim_cards_by_id; // nullptr for the ids of no card
+    std::array<std::vector<const SimCard*>, num_factions> summon_pools; // the player assaults of each faction (all of them for allfactions), for random summons
     const Card * by_id(unsigned id) const;
     void organize();
 };
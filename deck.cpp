@@ -22,22 +22,19 @@ std::string to_string(T val)
 
 std::map<signed, char> empty_marks;
 
-template<class RandomAccessIterator, class UniformRandomNumberGenerator>
+// Shuffles [first, middle) out of [first, last); partial_shuffle(first, last, last, re) shuffles it all.
+template<class RandomAccessIterator>
 void partial_shuffle(RandomAccessIterator first, RandomAccessIterator middle,
                      RandomAccessIterator last,
-                     UniformRandomNumberGenerator&& g)
+                     RandomEngine& re)
 {
     typedef typename std::iterator_traits<RandomAccessIterator>::difference_type diff_t;
-    typedef typename std::make_unsigned<diff_t>::type udiff_t;
-    typedef typename std::uniform_int_distribution<udiff_t> distr_t;
-    typedef typename distr_t::param_type param_t;
 
-    distr_t D;
     diff_t m = middle - first;
     diff_t n = last - first;
     for (diff_t i = 0; i < m; ++i)
     {
-        std::swap(first[i], first[D(g, param_t(i, n-1))]);
+        std::swap(first[i], first[i + re.bounded(n - i)]);
     }
 }
 
@@ -529,7 +526,7 @@ const Card* Deck::next()
     throw std::runtime_error("Unknown strategy for deck.");
 }
 
-void Deck::shuffle(std::mt19937& re)
+void Deck::shuffle(RandomEngine& re)
 {
     shuffled_cards.clear();
     boost::insert(shuffled_cards, shuffled_cards.end(), cards);
@@ -568,7 +565,7 @@ void Deck::shuffle(std::mt19937& re)
                 ++ shufflable_iter;
             }
         }
-        std::shuffle(shufflable_iter, shuffled_cards.end(), re);
+        partial_shuffle(shufflable_iter, shuffled_cards.end(), shuffled_cards.end(), re);
 #if 0
         if(!given_hand.empty())
         {
@@ -127,7 +127,7 @@ public:
     const Card* get_fortress2();
     void set_fortress2(const Card* card);
     const Card* next();
-    void shuffle(std::mt19937& re);
+    void shuffle(RandomEngine& re);
     void place_at_bottom(const Card* card);
 };
 
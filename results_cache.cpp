@@ -0,0 +1,169 @@
+#include "results_cache.h"
+
+#include <boost/interprocess/allocators/allocator.hpp>
+#include <boost/interprocess/containers/map.hpp>
+#include <boost/interprocess/containers/vector.hpp>
+#include <boost/interprocess/managed_mapped_file.hpp>
+#include <boost/interprocess/sync/file_lock.hpp>
+#include <fstream>
+#include <stdexcept>
+
+namespace bip = boost::interprocess;
+
+namespace {
+typedef bip::managed_mapped_file::segment_manager SegmentManager;
+typedef bip::allocator<Results<uint64_t>, SegmentManager> ResultsAllocator;
+
+// 128-bit key of a deck in its context
+struct CacheKey
+{
+    uint64_t hash[2];
+    bool operator<(const CacheKey& other) const
+    {
+        return(hash[0] < other.hash[0] || (hash[0] == other.hash[0] && hash[1] < other.hash[1]));
+    }
+};
+
+struct CachedResults
+{
+    bip::vector<Results<uint64_t>, ResultsAllocator> results; // per defense deck
+    unsigned total;
+    CachedResults(const ResultsAllocator& allocator) : results(allocator), total(0) {}
+};
+
+typedef std::pair<const CacheKey, CachedResults> CacheEntry;
+typedef bip::map<CacheKey, CachedResults, std::less<CacheKey>, bip::allocator<CacheEntry, SegmentManager>> CacheMap;
+
+// Bump the name when the layout of the file changes, older entries are then left alone.
+const char* const cache_map_name{"results 1"};
+const std::size_t cache_initial_size{1 << 20};
+
+// Two independent 64-bit lanes (FNV-1a and a multiplicative one) over the bytes, so the key stays stable across
+// runs and platforms, unlike std::hash.
+void digest(std::pair<uint64_t, uint64_t>& h, const std::string& s)
+{
+    for(unsigned char c: s)
+    {
+        h.first = (h.first ^ c) * 0x100000001b3ULL;
+        h.second = (h.second + c + 1) * 0x9e3779b97f4a7c15ULL;
+        h.second ^= h.second >> 29;
+    }
+}
+
+uint64_t mix(uint64_t z)
+{
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return(z ^ (z >> 31));
+}
+}
+
+// The mapping is dropped and made again whenever the file grows, the lock is kept all along.
+struct ResultsCacheFile
+{
+    std::unique_ptr<bip::managed_mapped_file> file;
+    CacheMap* map{nullptr};
+    bip::file_lock lock;
+};
+
+ResultsCache::ResultsCache(const std::string& filename, const std::string& context) :
+    m_filename(filename),
+    m_context(0xcbf29ce484222325ULL, 0),
+    m_file(new ResultsCacheFile)
+{
+    digest(m_context, context);
+    // The lock is taken before the file is mapped, on a file of its own: the lock needs an existing file, and
+    // boost can't open an empty one as a mapped file.
+    std::string lock_filename(filename + ".lock");
+    std::ofstream(lock_filename.c_str(), std::ios::app);
+    try
+    {
+        bip::file_lock lock(lock_filename.c_str());
+        if(!lock.try_lock())
+        {
+            throw std::runtime_error("results cache file " + filename + " is in use by another run");
+        }
+        m_file->lock.swap(lock);
+        open();
+    }
+    catch(bip::interprocess_exception& e)
+    {
+        throw std::runtime_error("results cache file " + filename + ": " + e.what());
+    }
+}
+
+ResultsCache::~ResultsCache()
+{
+    if(m_file->file)
+    {
+        m_file->file->flush();
+    }
+}
+
+void ResultsCache::open()
+{
+    m_file->file.reset(new bip::managed_mapped_file(bip::open_or_create, m_filename.c_str(), cache_initial_size));
+    m_file->map = m_file->file->find_or_construct<CacheMap>(cache_map_name)(std::less<CacheKey>(), m_file->file->get_segment_manager());
+}
+
+ResultsCache::DeckResults ResultsCache::find(const std::string& deck_key, unsigned num_def_decks) const
+{
+    std::pair<uint64_t, uint64_t> h(m_context);
+    digest(h, deck_key);
+    CacheKey key{{mix(h.first), mix(h.second)}};
+    DeckResults found{std::vector<Results<uint64_t>>(num_def_decks), 0};
+    auto it = m_file->map->find(key);
+    if(it != m_file->map->end() && it->second.results.size() == num_def_decks)
+    {
+        found.first.assign(it->second.results.begin(), it->second.results.end());
+        found.second = it->second.total;
+    }
+    return(found);
+}
+
+void ResultsCache::add(const std::string& deck_key, const DeckResults& results)
+{
+    if(results.second == 0)
+    {
+        return;
+    }
+    std::pair<uint64_t, uint64_t> h(m_context);
+    digest(h, deck_key);
+    CacheKey key{{mix(h.first), mix(h.second)}};
+    // On a full file: grow it by its size, map it again and retry.
+    while(true)
+    {
+        try
+        {
+            CacheMap& map(*m_file->map);
+            auto it = map.find(key);
+            if(it == map.end())
+            {
+                it = map.insert(CacheEntry(key, CachedResults(ResultsAllocator(m_file->file->get_segment_manager())))).first;
+            }
+            CachedResults& cached(it->second);
+            if(cached.results.size() != results.first.size())
+            {
+                cached.results.assign(results.first.size(), Results<uint64_t>());
+                cached.total = 0;
+            }
+            for(unsigned i(0); i < results.first.size(); ++i)
+            {
+                cached.results[i].merge(results.first[i]);
+            }
+            cached.total += results.second;
+            return;
+        }
+        catch(bip::bad_alloc&)
+        {
+            std::size_t size(m_file->file->get_size());
+            m_file->map = nullptr;
+            m_file->file.reset();
+            if(!bip::managed_mapped_file::grow(m_filename.c_str(), size))
+            {
+                throw std::runtime_error("results cache file " + m_filename + ": can't grow it");
+            }
+            open();
+        }
+    }
+}
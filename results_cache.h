@@ -0,0 +1,39 @@
+#ifndef RESULTS_CACHE_H_INCLUDED
+#define RESULTS_CACHE_H_INCLUDED
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+#include "sim.h"
+
+struct ResultsCacheFile;
+
+// Results of the battles of the attack decks, kept in a memory-mapped file across runs.
+// Every key is a digest of the context of the battles (defense decks, effect, modes, turn limit,
+// card pool, engine version...) followed by the deck, so a run only reads and adds to the battles
+// played in the same conditions. Only one run at a time may use a file.
+class ResultsCache
+{
+public:
+    typedef std::pair<std::vector<Results<uint64_t>>, unsigned> DeckResults;
+
+    // Opens or creates filename; throws std::runtime_error if it can't, or if another run uses it.
+    ResultsCache(const std::string& filename, const std::string& context);
+    ~ResultsCache();
+
+    // The battles stored for the deck, none if it was never evaluated in this context.
+    DeckResults find(const std::string& deck_key, unsigned num_def_decks) const;
+    // Adds new battles of the deck to the ones stored.
+    void add(const std::string& deck_key, const DeckResults& results);
+
+private:
+    std::string m_filename;
+    std::pair<uint64_t, uint64_t> m_context; // digest of the context, to be continued with the deck
+    std::unique_ptr<ResultsCacheFile> m_file;
+
+    void open();
+};
+
+#endif
@@ -2,6 +2,7 @@
 
 #include <boost/range/adaptors.hpp>
 #include <boost/range/join.hpp>
+#include <algorithm>
 #include <random>
 #include <string>
 #include <sstream>
@@ -20,6 +21,11 @@ std::string to_string(T val)
     s << val;
     return s.str();
 }
+// the 8-bit counters of CardStatus are numbers, not characters.
+inline std::string to_string(uint8_t val)
+{
+    return(to_string<unsigned>(val));
+}
 //---------------------- Debugging stuff ---------------------------------------
 unsigned debug_print(0);
 unsigned debug_cached(0);
@@ -45,7 +51,7 @@ std::string debug_str;
         if(__builtin_expect(debug_print >= 2, 0))                       \
         {                                                               \
             _DEBUG_MSG(2, "Possible targets of " format ":\n", ##args); \
-            fd->print_selection_array();                                \
+            fd->print_selection();                                      \
         }                                                               \
     }
 #else
@@ -58,84 +64,84 @@ inline std::string status_description(CardStatus* status)
     return status->description();
 }
 //------------------------------------------------------------------------------
-template <typename CardsIter, typename Functor>
-inline unsigned Field::make_selection_array(CardsIter first, CardsIter last, Functor f)
+inline void Board::update(size_type index)
 {
-    this->selection_array.clear();
-    for(auto c = first; c != last; ++c)
+    const CardStatus& status(begin()[index]);
+    alive.set(index, status.m_hp > 0);
+    phased.set(index, status.m_phased);
+    walls.set(index, status.m_card->m_wall);
+    for(auto& mask: factions) { mask.reset(index); }
+    factions[status.m_faction].set(index);
+}
+bool Board::masks_match() const
+{
+    for(size_type index(0); index < size(); ++index)
     {
-        if (f(*c))
+        const CardStatus& status(begin()[index]);
+        if(status.m_index != index || alive.test(index) != (status.m_hp > 0) || phased.test(index) != status.m_phased ||
+            walls.test(index) != status.m_card->m_wall || !factions[status.m_faction].test(index))
         {
-            this->selection_array.push_back(*c);
+            return(false);
         }
     }
-    return(this->selection_array.size());
+    return(true);
+}
+//------------------------------------------------------------------------------
+template <typename Functor>
+inline unsigned Field::select(Board& board, SlotMask candidates, Functor f)
+{
+    SlotMask selection;
+    for(unsigned index(0); index < board.size(); ++index)
+    {
+        if(candidates.test(index) && f(&board[index]))
+        {
+            selection.set(index);
+        }
+    }
+    return(select(board, selection));
+}
+inline unsigned Field::select(Board& board, SlotMask candidates)
+{
+    assert(board.masks_match());
+    this->selection_board = &board;
+    this->selection = candidates;
+    return(candidates.count());
+}
+// A random card of the selection, as its slot.
+inline unsigned select_random(Field* fd)
+{
+    return(fd->selection.nth(fd->rand(0, fd->selection.count() - 1)));
 }
-inline void Field::print_selection_array()
+inline void Field::print_selection()
 {
 #ifndef NDEBUG
-    for(auto c: this->selection_array)
+    for(SlotMask remaining(selection); !remaining.none(); )
     {
-        _DEBUG_MSG(2, "+ %s\n", status_description(c).c_str());
+        unsigned index(remaining.pop_first());
+        _DEBUG_MSG(2, "+ %s\n", status_description(selected(index)).c_str());
     }
 #endif
 }
+inline void Field::update_masks(const CardStatus* status)
+{
+    if(status->m_card->m_type == CardType::commander) { return; }
+    Hand* hand(players[status->m_player]);
+    Board& board(status->m_card->m_type == CardType::assault ? hand->assaults : hand->structures);
+    board.update(status - board.begin());
+}
 //------------------------------------------------------------------------------
-CardStatus::CardStatus(const Card* card) :
-    m_card(card),
-    m_index(0),
-    m_player(0),
-    m_augmented(0),
-    m_berserk(0),
-    m_blitzing(false),
-    m_chaosed(false),
-    m_corroded(0),
-    m_corrosion_speed(0),
-    m_delay(card->m_delay),
-    m_diseased(false),
-    m_enfeebled(0),
-    m_enhance_armored(0),
-    m_enhance_berserk(0),
-    m_enhance_corrosive(0),
-    m_enhance_counter(0),
-    m_enhance_enfeeble(0),
-    m_enhance_evade(0),
-    m_enhance_heal(0),
-    m_enhance_leech(0),
-    m_enhance_poison(0),
-    m_enhance_rally(0),
-    m_enhance_strike(0),
-    m_evades_left(card->m_evade),
-    m_faction(card->m_faction),
-    m_flurry_charge(card->m_flurry),
-    m_frozen(false),
-    m_has_jammed(false),
-    m_hp(card->m_health),
-    m_immobilized(false),
-    m_infused(false),
-    m_inhibited(0),
-    m_jammed(false),
-    m_jam_charge(card->m_jam),
-    m_phased(false),
-    m_poisoned(0),
-    m_protected(0),
-    m_rallied(0),
-    m_stunned(0),
-    m_sundered(false),
-    m_weakened(0),
-    m_temporary_split(false),
-    m_is_summoned(false),
-    m_step(CardStep::none)
+CardStatus::CardStatus(const Card* card)
 {
+    set(card);
 }
 
 //------------------------------------------------------------------------------
 inline void CardStatus::set(const Card* card)
 {
-    this->set(*card);
+    this->set(*card->m_sim_card);
 }
 //------------------------------------------------------------------------------
-inline void CardStatus::set(const Card& card)
+inline void CardStatus::set(const SimCard& card)
 {
     m_card = &card;
     m_index = 0;
@@ -190,27 +196,27 @@ inline int attack_power(CardStatus* att)
 //------------------------------------------------------------------------------
 std::string skill_description(const Cards& cards, const SkillSpec& s)
 {
-    switch(std::get<0>(s))
+    switch(s.id)
     {
     case summon:
-        if(std::get<1>(s) == 0)
+        if(s.value == 0)
         {
             // Summon X
-            return(skill_names[std::get<0>(s)] + " X" +
-                    skill_activation_modifier_names[std::get<4>(s)]);
+            return(skill_names[s.id] + " X" +
+                    skill_activation_modifier_names[s.mod]);
         }
         else
         {
-            return(skill_names[std::get<0>(s)] +
-                    " " + cards.by_id(std::get<1>(s))->m_name.c_str() +
-                    skill_activation_modifier_names[std::get<4>(s)]);
+            return(skill_names[s.id] +
+                    " " + cards.by_id(s.value)->m_name.c_str() +
+                    skill_activation_modifier_names[s.mod]);
         }
     default:
-        return(skill_names[std::get<0>(s)] +
-           (std::get<3>(s) ? " all" : "") +
-           (std::get<2>(s) == allfactions ? "" : std::string(" ") + faction_names[std::get<2>(s)]) +
-           (std::get<1>(s) == 0 ? "" : std::string(" ") + to_string(std::get<1>(s))) +
-           skill_activation_modifier_names[std::get<4>(s)]);
+        return(skill_names[s.id] +
+           (s.all ? " all" : "") +
+           (s.faction == allfactions ? "" : std::string(" ") + faction_names[s.faction]) +
+           (s.value == 0 ? "" : std::string(" ") + to_string(s.value)) +
+           skill_activation_modifier_names[s.mod]);
     }
 }
 //------------------------------------------------------------------------------
@@ -294,7 +300,7 @@ std::string CardStatus::description()
     case CardType::structure: desc = "Structure " + to_string(m_index) + " "; break;
     case CardType::num_cardtypes: assert(false); break;
     }
-    desc += "[" + m_card->m_name;
+    desc += "[" + m_card->m_info->m_name;
     switch(m_card->m_type)
     {
     case CardType::action:
@@ -394,7 +400,7 @@ inline void print_achievement_results(Field* fd)
 #endif
 }
 //------------------------------------------------------------------------------
-void Hand::reset(std::mt19937& re)
+void Hand::reset(RandomEngine& re)
 {
     assaults.reset();
     structures.reset();
@@ -414,102 +420,125 @@ inline unsigned opponent(unsigned player)
 //------------------------------------------------------------------------------
 SkillSpec apply_augment(const CardStatus* status, const SkillSpec& s)
 {
-    if (std::get<0>(s) == augment || std::get<0>(s) == summon || std::get<1>(s) == 0)
+    if (s.id == augment || s.id == summon || s.value == 0)
     {
         return s;
     }
     SkillSpec augmented_s = s;
-    std::get<1>(augmented_s) += status->m_augmented;
+    augmented_s.value += status->m_augmented;
     return(augmented_s);
 }
 SkillSpec apply_fusion(const SkillSpec& s)
 {
     SkillSpec fusioned_s = s;
-    std::get<1>(fusioned_s) *= 2;
+    fusioned_s.value *= 2;
     return(fusioned_s);
 }
 SkillSpec apply_infuse(const SkillSpec& s)
 {
-    if (std::get<2>(s) == allfactions || std::get<2>(s) == bloodthirsty || helpful_skills.find(std::get<0>(s)) == helpful_skills.end())
+    if (s.faction == allfactions || s.faction == bloodthirsty || helpful_skills.find(s.id) == helpful_skills.end())
     {
         return s;
     }
     SkillSpec infused_s = s;
-    std::get<2>(infused_s) = bloodthirsty;
+    infused_s.faction = bloodthirsty;
     return(infused_s);
 }
 //------------------------------------------------------------------------------
-bool may_change_skill(const Field* fd, const CardStatus* status, const SkillMod::SkillMod mod)
+// Whether the battleground effect changes the skills of a card, whatever the state of the battle (see may_change_skill).
+bool effect_changes_skill(const Effect effect, const SimCard* card, const SkillMod::SkillMod mod)
 {
     switch (mod)
     {
         case SkillMod::on_activate:
-            switch (status->m_card->m_type)
+            switch (card->m_type)
             {
                 case CardType::commander:
-                    return (fd->effect == Effect::armored_1 ||
-                            fd->effect == Effect::armored_2 ||
-                            fd->effect == Effect::armored_3 ||
-                            fd->effect == Effect::berserk_1 ||
-                            fd->effect == Effect::berserk_2 ||
-                            fd->effect == Effect::berserk_3 ||
-                            fd->effect == Effect::corrosive_1 ||
-                            fd->effect == Effect::corrosive_2 ||
-                            fd->effect == Effect::corrosive_3 ||
-                            fd->effect == Effect::counter_1 ||
-                            fd->effect == Effect::counter_2 ||
-                            fd->effect == Effect::counter_3 ||
-                            fd->effect == Effect::enfeeble_1 ||
-                            fd->effect == Effect::enfeeble_2 ||
-                            fd->effect == Effect::enfeeble_3 ||
-                            fd->effect == Effect::evade_1 ||
-                            fd->effect == Effect::evade_2 ||
-                            fd->effect == Effect::evade_3 ||
-                            fd->effect == Effect::heal_1 ||
-                            fd->effect == Effect::heal_2 ||
-                            fd->effect == Effect::heal_3 ||
-                            fd->effect == Effect::leech_1 ||
-                            fd->effect == Effect::leech_2 ||
-                            fd->effect == Effect::leech_3 ||
-                            fd->effect == Effect::overload_1 ||
-                            fd->effect == Effect::overload_2 ||
-                            fd->effect == Effect::overload_3 ||
-                            fd->effect == Effect::poison_1 ||
-                            fd->effect == Effect::poison_2 ||
-                            fd->effect == Effect::poison_3 ||
-                            fd->effect == Effect::rally_1 ||
-                            fd->effect == Effect::rally_2 ||
-                            fd->effect == Effect::rally_3 ||
-                            fd->effect == Effect::strike_1 ||
-                            fd->effect == Effect::strike_2 ||
-                            fd->effect == Effect::strike_3 ||
-                            fd->effect == Effect::time_surge ||
-                            fd->effect == Effect::friendly_fire ||
-                            fd->effect == Effect::genesis ||
-                            (fd->effect == Effect::artillery_strike && fd->turn >= 9 && status->m_player == (fd->optimization_mode == OptimizationMode::defense ? 1u : 0u)) ||
-                            fd->effect == Effect::decrepit ||
-                            fd->effect == Effect::forcefield ||
-                            fd->effect == Effect::chilling_touch);
+                    return (effect == Effect::armored_1 ||
+                            effect == Effect::armored_2 ||
+                            effect == Effect::armored_3 ||
+                            effect == Effect::berserk_1 ||
+                            effect == Effect::berserk_2 ||
+                            effect == Effect::berserk_3 ||
+                            effect == Effect::corrosive_1 ||
+                            effect == Effect::corrosive_2 ||
+                            effect == Effect::corrosive_3 ||
+                            effect == Effect::counter_1 ||
+                            effect == Effect::counter_2 ||
+                            effect == Effect::counter_3 ||
+                            effect == Effect::enfeeble_1 ||
+                            effect == Effect::enfeeble_2 ||
+                            effect == Effect::enfeeble_3 ||
+                            effect == Effect::evade_1 ||
+                            effect == Effect::evade_2 ||
+                            effect == Effect::evade_3 ||
+                            effect == Effect::heal_1 ||
+                            effect == Effect::heal_2 ||
+                            effect == Effect::heal_3 ||
+                            effect == Effect::leech_1 ||
+                            effect == Effect::leech_2 ||
+                            effect == Effect::leech_3 ||
+                            effect == Effect::overload_1 ||
+                            effect == Effect::overload_2 ||
+                            effect == Effect::overload_3 ||
+                            effect == Effect::poison_1 ||
+                            effect == Effect::poison_2 ||
+                            effect == Effect::poison_3 ||
+                            effect == Effect::rally_1 ||
+                            effect == Effect::rally_2 ||
+                            effect == Effect::rally_3 ||
+                            effect == Effect::strike_1 ||
+                            effect == Effect::strike_2 ||
+                            effect == Effect::strike_3 ||
+                            effect == Effect::time_surge ||
+                            effect == Effect::friendly_fire ||
+                            effect == Effect::genesis ||
+                            effect == Effect::artillery_strike ||
+                            effect == Effect::decrepit ||
+                            effect == Effect::forcefield ||
+                            effect == Effect::chilling_touch);
                 case CardType::assault:
-                    return (fd->effect == Effect::friendly_fire ||
-                            ((fd->effect == Effect::clone_project || fd->effect == Effect::clone_experiment) && status->m_temporary_split));
+                    return (effect == Effect::friendly_fire ||
+                            effect == Effect::clone_project || effect == Effect::clone_experiment);
                 default:
                     break;
             }
             break;
         case SkillMod::on_death:
-            return ((status->m_card->m_type == CardType::assault || status->m_card->m_type == CardType::structure) &&
-                    fd->effect == Effect::haunt && status->m_card->m_faction != bloodthirsty);
+            return ((card->m_type == CardType::assault || card->m_type == CardType::structure) &&
+                    effect == Effect::haunt && card->m_faction != bloodthirsty);
         default:
             break;
     }
     return false;
 }
-SkillSpec apply_battleground_effect(const Field* fd, const CardStatus* status, const SkillSpec& ss, const SkillMod::SkillMod mod, bool& need_add_skill)
+// Only artillery_strike and the clone effects depend on the battle.
+inline bool is_battle_dependent(const Effect effect)
 {
-    const auto& skill = std::get<0>(ss);
-    unsigned skill_value = 0;
+    return(effect == Effect::artillery_strike || effect == Effect::clone_project || effect == Effect::clone_experiment);
+}
+bool may_change_skill(const Field* fd, const CardStatus* status, const SkillMod::SkillMod mod)
+{
+    if(!effect_changes_skill(fd->effect, status->m_card, mod))
+    {
+        return false;
+    }
     switch (fd->effect)
+    {
+        case Effect::artillery_strike:
+            return (fd->turn >= 9 && status->m_player == (fd->optimization_mode == OptimizationMode::defense ? 1u : 0u));
+        case Effect::clone_project:
+        case Effect::clone_experiment:
+            return (status->m_temporary_split);
+        default:
+            return true;
+    }
+}
+SkillSpec apply_battleground_effect(const Effect effect, const SimCard* card, const SkillSpec& ss, const SkillMod::SkillMod mod, bool& need_add_skill)
+{
+    const auto& skill = ss.id;
+    unsigned skill_value = 0;
+    switch (effect)
     {
         case Effect::armored_1:
         case Effect::berserk_1:
@@ -557,7 +586,7 @@ SkillSpec apply_battleground_effect(const Field* fd, const CardStatus* status, c
         default:
             break;
     }
-    switch (fd->effect)
+    switch (effect)
     {
         case Effect::armored_1:
         case Effect::armored_2:
@@ -688,7 +717,7 @@ SkillSpec apply_battleground_effect(const Field* fd, const CardStatus* status, c
             }
             break;
         case Effect::friendly_fire:
-            switch (status->m_card->m_type)
+            switch (card->m_type)
             {
                 case CardType::assault:
                     // no gain the skill if already have
@@ -767,10 +796,69 @@ SkillSpec apply_battleground_effect(const Field* fd, const CardStatus* status, c
     return ss;
 }
 //------------------------------------------------------------------------------
+// The skills of a card as played under a battleground effect, in the order evaluate_skills() and prepend_on_death()
+// have them: a skill granted by the effect comes first when activated, last on death.
+SkillProgram compile_skill_program(const Effect effect, const SimCard* card)
+{
+    SkillProgram program;
+    auto mod = SkillMod::on_activate;
+    bool need_add_skill = effect_changes_skill(effect, card, mod);
+    program.battle_dependent = need_add_skill && is_battle_dependent(effect);
+    if(need_add_skill)
+    {
+        auto battleground_s = apply_battleground_effect(effect, card, SkillSpec(new_skill, 0, allfactions, false, mod), mod, need_add_skill);
+        assert(battleground_s.id != new_skill);
+        program.skills.push_back(battleground_s);
+    }
+    for(auto& ss: card->m_skills)
+    {
+        program.skills.push_back(need_add_skill ? apply_battleground_effect(effect, card, ss, mod, need_add_skill) : ss);
+    }
+    mod = SkillMod::on_death;
+    need_add_skill = effect_changes_skill(effect, card, mod);
+    for(auto& ss: card->m_skills_on_death)
+    {
+        program.skills_on_death.push_back(need_add_skill ? apply_battleground_effect(effect, card, ss, mod, need_add_skill) : ss);
+    }
+    if(need_add_skill)
+    {
+        auto battleground_s = apply_battleground_effect(effect, card, SkillSpec(new_skill, 0, allfactions, false, mod), mod, need_add_skill);
+        assert(battleground_s.id != new_skill);
+        program.skills_on_death.push_back(battleground_s);
+    }
+    return(program);
+}
+std::vector<Effect> compiled_effects; // the effect of each skill program of the cards
+unsigned compile_skills(Cards& cards, const Effect effect)
+{
+    auto found = std::find(compiled_effects.begin(), compiled_effects.end(), effect);
+    if(found != compiled_effects.end())
+    {
+        return(found - compiled_effects.begin());
+    }
+    for(SimCard& card: cards.sim_cards)
+    {
+        card.m_skill_programs.emplace_back(compile_skill_program(effect, &card));
+    }
+    compiled_effects.push_back(effect);
+    return(compiled_effects.size() - 1);
+}
+unsigned skill_program_of(const Effect effect)
+{
+    unsigned program = std::find(compiled_effects.begin(), compiled_effects.end(), effect) - compiled_effects.begin();
+    assert(program < compiled_effects.size());
+    return(program);
+}
+inline SkillList activation_skills(const Field* fd, const CardStatus* status)
+{
+    const SkillProgram& program(status->m_card->m_skill_programs[fd->skill_program]);
+    return(program.battle_dependent && !may_change_skill(fd, status, SkillMod::on_activate) ? status->m_card->m_skills : program.skills);
+}
+//------------------------------------------------------------------------------
 void prepend_on_death(Field* fd)
 {
-    std::vector<std::tuple<CardStatus*, SkillSpec>> od_skills;
-    auto mod = SkillMod::on_death;
+    auto& od_skills(fd->on_death_skills);
+    od_skills.clear();
     for(auto status: fd->killed_with_on_death)
     {
         if(status->m_jammed)
@@ -778,23 +866,17 @@ void prepend_on_death(Field* fd)
             _DEBUG_MSG(2, "%s is jammed and cannot activate its on Death skill.\n", status_description(status).c_str());
             continue;
         }
-        bool need_add_skill = may_change_skill(fd, status, mod);
-        for(auto& ss: status->m_card->m_skills_on_death)
+        for(auto& ss: status->m_card->m_skill_programs[fd->skill_program].skills_on_death)
         {
-            auto& battleground_s = need_add_skill ? apply_battleground_effect(fd, status, ss, mod, need_add_skill) : ss;
-            _DEBUG_MSG(2, "Preparing %s skill %s\n", status_description(status).c_str(), skill_description(fd->cards, battleground_s).c_str());
-            od_skills.emplace_back(status, battleground_s);
+            _DEBUG_MSG(2, "Preparing %s skill %s\n", status_description(status).c_str(), skill_description(fd->cards, ss).c_str());
+            od_skills.emplace_back(status, ss);
             //if(__builtin_expect(fd->end, false)) { return; }  // so far no "on Death" skill may end the battle
         }
-        if(need_add_skill)
-        {
-            auto battleground_s = apply_battleground_effect(fd, status, SkillSpec(new_skill, 0, allfactions, false, mod), mod, need_add_skill);
-            assert(std::get<0>(battleground_s) != new_skill);
-            _DEBUG_MSG(2, "Preparing %s skill %s\n", status_description(status).c_str(), skill_description(fd->cards, battleground_s).c_str());
-            od_skills.emplace_back(status, battleground_s);
-        }
     }
-    fd->skill_queue.insert(fd->skill_queue.begin(), od_skills.begin(), od_skills.end());
+    for(auto& skill_instance: boost::adaptors::reverse(od_skills))
+    {
+        fd->skill_queue.emplace_front(skill_instance);
+    }
     fd->killed_with_on_death.clear();
 }
 //------------------------------------------------------------------------------
@@ -810,7 +892,7 @@ void resolve_skill(Field* fd)
         if(!status)
         {
             // trigger_regen
-            skill_table[std::get<0>(skill)](fd, status, skill);
+            skill_table[skill.id](fd, status, skill);
         }
         else if(!status->m_jammed)
         {
@@ -818,41 +900,41 @@ void resolve_skill(Field* fd)
             auto& augmented_s = status->m_augmented > 0 ? apply_augment(status, skill) : skill;
             auto& fusioned_s = fusion_active ? apply_fusion(augmented_s) : augmented_s;
             auto& infused_s = status->m_infused ? apply_infuse(fusioned_s) : fusioned_s;
-            skill_table[std::get<0>(skill)](fd, status, infused_s);
+            skill_table[skill.id](fd, status, infused_s);
         }
     }
 }
 //------------------------------------------------------------------------------
+template<typename Mode>
 void attack_phase(Field* fd);
-void evaluate_skills(Field* fd, CardStatus* status, const std::vector<SkillSpec>& skills, const SkillMod::SkillMod mod)
+// skills: as compiled for the battleground effect when it may change them, see activation_skills()
+void evaluate_skills(Field* fd, CardStatus* status, const SkillList skills)
 {
     assert(status);
     assert(fd->skill_queue.size() == 0);
-    bool need_add_skill = may_change_skill(fd, status, mod);
-    if(need_add_skill)
-    {
-        auto battleground_s = apply_battleground_effect(fd, status, SkillSpec(new_skill, 0, allfactions, false, mod), mod, need_add_skill);
-        assert(std::get<0>(battleground_s) != new_skill);
-        _DEBUG_MSG(2, "Evaluating %s skill %s\n", status_description(status).c_str(), skill_description(fd->cards, battleground_s).c_str());
-        fd->skill_queue.emplace_back(status, battleground_s);
-        resolve_skill(fd);
-    }
     for(auto& ss: skills)
     {
-        auto& battleground_s = need_add_skill ? apply_battleground_effect(fd, status, ss, mod, need_add_skill) : ss;
-        _DEBUG_MSG(2, "Evaluating %s skill %s\n", status_description(status).c_str(), skill_description(fd->cards, battleground_s).c_str());
-        fd->skill_queue.emplace_back(status, battleground_s);
+        _DEBUG_MSG(2, "Evaluating %s skill %s\n", status_description(status).c_str(), skill_description(fd->cards, ss).c_str());
+        fd->skill_queue.emplace_back(status, ss);
         resolve_skill(fd);
         if(__builtin_expect(fd->end, false)) { break; }
     }
 }
 bool check_and_perform_blitz(Field* fd, CardStatus* src_status);
+// What the battle loop is compiled for: whether a battleground effect is set, and whether an achievement is counted.
+// Without them, the checks of the effects and the achievement counters are compiled out, see play_function().
+template<bool with_effect_, bool with_achievement_>
+struct BattleMode
+{
+    static constexpr bool with_effect = with_effect_;
+    static constexpr bool with_achievement = with_achievement_;
+};
 struct PlayCard
 {
     const Card* card;
     Field* fd;
     CardStatus* status;
-    Storage<CardStatus>* storage;
+    Board* storage;
 
     PlayCard(const Card* card_, Field* fd_) :
         card{card_},
@@ -861,14 +943,22 @@ struct PlayCard
         storage{nullptr}
     {}
 
-    template <enum CardType::CardType type>
+    template <typename Mode, enum CardType::CardType type>
     bool op()
     {
         setStorage<type>();
-        placeCard<type>();
+        if(storage->full())
+        {
+            _DEBUG_MSG(1, "%s cannot play %s: the board is full\n", status_description(&fd->tap->commander).c_str(), card_description(fd->cards, card).c_str());
+            return(false);
+        }
+        placeCard<Mode, type>();
         blitz<type>();
         onPlaySkills<type>();
-        fieldEffects<type>();
+        if(Mode::with_effect)
+        {
+            fieldEffects<type>();
+        }
         return(true);
     }
 
@@ -877,18 +967,19 @@ struct PlayCard
     {
     }
 
-    template <enum CardType::CardType type>
+    template <typename Mode, enum CardType::CardType type>
     void placeCard()
     {
         status = &storage->add_back();
         status->set(card);
         status->m_index = storage->size() - 1;
         status->m_player = fd->tapi;
-        if((fd->turn == 1 && fd->gamemode == tournament && status->m_delay > 0) || (type == CardType::assault && fd->effect == Effect::harsh_conditions))
+        storage->update(status->m_index);
+        if((fd->turn == 1 && fd->gamemode == tournament && status->m_delay > 0) || (Mode::with_effect && type == CardType::assault && fd->effect == Effect::harsh_conditions))
         {
             ++status->m_delay;
         }
-        if(status->m_player == 0)
+        if(Mode::with_achievement && status->m_player == 0)
         {
             fd->inc_counter(fd->achievement.unit_played, card->m_id);
             fd->inc_counter(fd->achievement.unit_type_played, card->m_type);
@@ -914,7 +1005,7 @@ struct PlayCard
     template <enum CardType::CardType>
     void onPlaySkills()
     {
-        evaluate_skills(fd, status, card->m_skills_on_play, SkillMod::on_play);
+        evaluate_skills(fd, status, status->m_card->m_skills_on_play);
     }
 };
 // assault
@@ -971,7 +1062,7 @@ void remove_corroded(CardStatus* att_status)
 template <>
 void PlayCard::onPlaySkills<CardType::action>()
 {
-    evaluate_skills(fd, status, card->m_skills, SkillMod::on_play);
+    evaluate_skills(fd, status, status->m_card->m_skills);
 }
 //------------------------------------------------------------------------------
 inline bool is_attacking_or_has_attacked(CardStatus* c) { return(c->m_step >= CardStep::attacking); }
@@ -985,8 +1076,10 @@ inline bool can_attack(CardStatus* c) { return(can_act(c) && !c->m_immobilized &
 // Can be healed / repaired
 inline bool can_be_healed(CardStatus* c) { return(c->m_hp > 0 && c->m_hp < c->m_card->m_health && !c->m_diseased); }
 //------------------------------------------------------------------------------
+template<typename Mode>
 void turn_start_phase(Field* fd);
 void turn_end_phase(Field* fd);
+template<typename Mode>
 void evaluate_legion(Field* fd);
 bool check_and_perform_refresh(Field* fd, CardStatus* src_status);
 
@@ -1148,8 +1241,14 @@ inline bool count_achievement(Field* fd, const CardStatus* c)
     }
     return(true);
 }
+template<typename Mode, Skill skill_id>
+inline bool count_achievement(Field* fd, const CardStatus* c)
+{
+    return(!Mode::with_achievement || count_achievement<skill_id>(fd, c));
+}
 
 // return value : (raid points) -> attacker wins, 0 -> defender wins
+template<typename Mode>
 Results<uint64_t> play(Field* fd)
 {
     fd->players[0]->commander.m_player = 0;
@@ -1174,30 +1273,36 @@ Results<uint64_t> play(Field* fd)
     fd->last_decision_turn = p0_size == 1 ? 0 : p0_size * 2 - (fd->gamemode == surge ? 2 : 3);
 
     // Count commander as played for achievements (not count in type / faction / rarity requirements)
-    fd->inc_counter(fd->achievement.unit_played, fd->players[0]->commander.m_card->m_id);
+    if(Mode::with_achievement)
+    {
+        fd->inc_counter(fd->achievement.unit_played, fd->players[0]->commander.m_card->m_id);
+    }
 
     if(fd->players[fd->tapi]->deck->fortress1 != nullptr)
     {
-        PlayCard(fd->players[fd->tapi]->deck->fortress1, fd).op<CardType::structure>();
+        PlayCard(fd->players[fd->tapi]->deck->fortress1, fd).op<Mode, CardType::structure>();
     }
     if(fd->players[fd->tapi]->deck->fortress2 != nullptr)
     {
-        PlayCard(fd->players[fd->tapi]->deck->fortress2, fd).op<CardType::structure>();
+        PlayCard(fd->players[fd->tapi]->deck->fortress2, fd).op<Mode, CardType::structure>();
     }
     std::swap(fd->tapi, fd->tipi);
     std::swap(fd->tap, fd->tip);
     if(fd->players[fd->tapi]->deck->fortress1 != nullptr)
     {
-        PlayCard(fd->players[fd->tapi]->deck->fortress1, fd).op<CardType::structure>();
+        PlayCard(fd->players[fd->tapi]->deck->fortress1, fd).op<Mode, CardType::structure>();
     }
     if(fd->players[fd->tapi]->deck->fortress2 != nullptr)
     {
-        PlayCard(fd->players[fd->tapi]->deck->fortress2, fd).op<CardType::structure>();
+        PlayCard(fd->players[fd->tapi]->deck->fortress2, fd).op<Mode, CardType::structure>();
     }
     std::swap(fd->tapi, fd->tipi);
     std::swap(fd->tap, fd->tip);
 
-    fd->set_counter(fd->achievement.misc_req, AchievementMiscReq::turns, 1);
+    if(Mode::with_achievement)
+    {
+        fd->set_counter(fd->achievement.misc_req, AchievementMiscReq::turns, 1);
+    }
     while(__builtin_expect(fd->turn <= turn_limit && !fd->end, true))
     {
         fd->current_phase = Field::playcard_phase;
@@ -1212,20 +1317,20 @@ Results<uint64_t> play(Field* fd)
             fd->points_since_last_decision = 0;
         }
 #endif
-        turn_start_phase(fd);
+        turn_start_phase<Mode>(fd);
         // Special case: refresh on commander
         if(fd->tip->commander.m_card->m_refresh)
         {
             check_and_perform_refresh(fd, &fd->tip->commander);
         }
 
-        if(fd->effect == Effect::clone_project ||
-           (fd->effect == Effect::clone_experiment && (fd->turn == 9 || fd->turn == 10)))
+        if(Mode::with_effect && (fd->effect == Effect::clone_project ||
+           (fd->effect == Effect::clone_experiment && (fd->turn == 9 || fd->turn == 10))))
         {
-            if(fd->make_selection_array(fd->tap->assaults.m_indirect.begin(), fd->tap->assaults.m_indirect.end(), [](CardStatus* c){return(c->m_delay == 0 && c->m_hp > 0);}) > 0)
+            if(fd->select(fd->tap->assaults, fd->tap->assaults.alive, [](CardStatus* c){return(c->m_delay == 0);}) > 0)
             {
                 _DEBUG_SELECTION("Clone effect");
-                CardStatus* c(fd->selection_array[fd->rand(0, fd->selection_array.size() - 1)]);
+                CardStatus* c(fd->selected(select_random(fd)));
                 _DEBUG_MSG(1, "%s gains skill Split until end of turn.\n", status_description(c).c_str());
                 c->m_temporary_split = true;
             }
@@ -1239,13 +1344,13 @@ Results<uint64_t> play(Field* fd)
             {
             case CardType::action:
                 // end: handles commander death by shock
-                PlayCard(played_card, fd).op<CardType::action>();
+                PlayCard(played_card, fd).op<Mode, CardType::action>();
                 break;
             case CardType::assault:
-                PlayCard(played_card, fd).op<CardType::assault>();
+                PlayCard(played_card, fd).op<Mode, CardType::assault>();
                 break;
             case CardType::structure:
-                PlayCard(played_card, fd).op<CardType::structure>();
+                PlayCard(played_card, fd).op<Mode, CardType::structure>();
                 break;
             case CardType::commander:
             case CardType::num_cardtypes:
@@ -1257,11 +1362,11 @@ Results<uint64_t> play(Field* fd)
 
         // Evaluate Legion skill
         fd->current_phase = Field::legion_phase;
-        evaluate_legion(fd);
+        evaluate_legion<Mode>(fd);
 
         // Evaluate commander
         fd->current_phase = Field::commander_phase;
-        evaluate_skills(fd, &fd->tap->commander, fd->tap->commander.m_card->m_skills, SkillMod::on_activate);
+        evaluate_skills(fd, &fd->tap->commander, activation_skills(fd, &fd->tap->commander));
         if(__builtin_expect(fd->end, false)) { break; }
 
         // Evaluate structures
@@ -1271,7 +1376,7 @@ Results<uint64_t> play(Field* fd)
             CardStatus& current_status(fd->tap->structures[fd->current_ci]);
             if(current_status.m_delay == 0 && current_status.m_hp > 0)
             {
-                evaluate_skills(fd, &current_status, current_status.m_card->m_skills, SkillMod::on_activate);
+                evaluate_skills(fd, &current_status, activation_skills(fd, &current_status));
             }
         }
         // Evaluate assaults
@@ -1299,7 +1404,7 @@ Results<uint64_t> play(Field* fd)
             for(unsigned attack_index(0); attack_index < num_attacks && can_attack(&current_status) && fd->tip->commander.m_hp > 0; ++attack_index)
             {
                 // Evaluate skills
-                evaluate_skills(fd, &current_status, current_status.m_card->m_skills, SkillMod::on_activate);
+                evaluate_skills(fd, &current_status, activation_skills(fd, &current_status));
                 if(__builtin_expect(fd->end, false)) { break; }
 
                 // Attack
@@ -1307,7 +1412,7 @@ Results<uint64_t> play(Field* fd)
                 {
                     auto restore_status = current_status.m_step;
                     current_status.m_step = CardStep::attacking;
-                    attack_phase(fd);
+                    attack_phase<Mode>(fd);
                     current_status.m_step = restore_status;
                 }
             }
@@ -1319,7 +1424,10 @@ Results<uint64_t> play(Field* fd)
         std::swap(fd->tapi, fd->tipi);
         std::swap(fd->tap, fd->tip);
         ++fd->turn;
-        fd->inc_counter(fd->achievement.misc_req, AchievementMiscReq::turns);
+        if(Mode::with_achievement)
+        {
+            fd->inc_counter(fd->achievement.misc_req, AchievementMiscReq::turns);
+        }
     }
     if(fd->optimization_mode == OptimizationMode::gw_abp)
     {
@@ -1371,7 +1479,7 @@ Results<uint64_t> play(Field* fd)
         if(fd->players[1]->commander.m_hp == 0)
         {
             _DEBUG_MSG(1, "You win (boss killed).\n");
-            return {1, 0, 0, fd->players[1]->commander.m_card->m_health + 50, 0};
+            return {1, 0, 0, fd->players[1]->commander.m_card->m_health + 50u, 0};
         }
         else
         {
@@ -1413,6 +1521,15 @@ Results<uint64_t> play(Field* fd)
     return {0, 0, 0, 0, 0};
 }
 
+PlayFunction play_function(const Effect effect, const Achievement& achievement)
+{
+    bool with_achievement(!achievement.req_counter.empty());
+    if(effect == Effect::none)
+    {
+        return(with_achievement ? &play<BattleMode<false, true>> : &play<BattleMode<false, false>>);
+    }
+    return(with_achievement ? &play<BattleMode<true, true>> : &play<BattleMode<true, false>>);
+}
 
 //------------------------------------------------------------------------------
 // All the stuff that happens at the beginning of a turn, before a card is played
@@ -1439,6 +1556,7 @@ void remove_hp(Field* fd, CardStatus& status, unsigned dmg)
     if(status.m_hp == 0)
     {
         _DEBUG_MSG(1, "%s dies\n", status_description(&status).c_str());
+        fd->update_masks(&status);
         if(status.m_card->m_skills_on_death.size() > 0 || fd->effect == Effect::haunt)
         {
             fd->killed_with_on_death.push_back(&status);
@@ -1465,14 +1583,19 @@ inline bool is_it_dead(CardStatus& c)
     }
     else { return(false); } // nope still kickin'
 }
-inline void remove_dead(Storage<CardStatus>& storage)
+inline void remove_dead(Board& storage)
 {
+    if((storage.occupied() & ~storage.alive).none()) { return; }
     storage.remove(is_it_dead);
 }
 inline void add_hp(Field* fd, CardStatus* target, unsigned v)
 {
     unsigned old_hp = target->m_hp;
-    target->m_hp = std::min(target->m_hp + v, target->m_card->m_health);
+    target->m_hp = std::min<unsigned>(target->m_hp + v, target->m_card->m_health);
+    if(old_hp == 0)
+    {
+        fd->update_masks(target);
+    }
     if(fd->effect == Effect::invigorate && target->m_card->m_type == CardType::assault && skill_check<berserk>(fd, target, nullptr))
     {
         unsigned healed = target->m_hp - old_hp;
@@ -1551,8 +1674,14 @@ void turn_end_phase(Field* fd)
     }
 
 }
+template<typename Mode>
 void turn_start_phase(Field* fd)
 {
+    // Perform on death skills and regen of the cards killed by poison damage, while they are still on the board:
+    // the killed_with_* lists point into the storages.
+    prepend_on_death(fd);
+    resolve_skill(fd);
+    check_regeneration(fd);
     remove_dead(fd->tap->assaults);
     remove_dead(fd->tap->structures);
     remove_dead(fd->tip->assaults);
@@ -1562,7 +1691,6 @@ void turn_start_phase(Field* fd)
     if(fd->tap->commander.m_card->m_jam > 0 && fd->tap->commander.m_jam_charge < fd->tap->commander.m_card->m_jam) {++fd->tap->commander.m_jam_charge;}
     if(fd->tap->commander.m_card->m_flurry > 0 && fd->tap->commander.m_flurry_charge < fd->tap->commander.m_card->m_flurry) {++fd->tap->commander.m_flurry_charge;}
     // Active player's assault cards:
-    // update index
     // remove enfeeble, protect; apply poison damage, reduce delay
     {
         auto& assaults(fd->tap->assaults);
@@ -1571,21 +1699,7 @@ void turn_start_phase(Field* fd)
             ++index)
         {
             CardStatus& status(assaults[index]);
-            status.m_index = index;
-            status.m_enfeebled = 0;
-            status.m_protected = 0;
-            //reset enhance_...
-            status.m_enhance_armored = 0;
-            status.m_enhance_berserk = 0;
-            status.m_enhance_corrosive = 0;
-            status.m_enhance_counter = 0;
-            status.m_enhance_enfeeble = 0;
-            status.m_enhance_evade = 0;
-            status.m_enhance_leech = 0;
-            status.m_enhance_heal = 0;
-            status.m_enhance_poison = 0;
-            status.m_enhance_rally = 0;
-            status.m_enhance_strike = 0;
+            status.reset_turn_modifiers();
             status.m_evades_left = status.m_card->m_evade;
             if(status.m_delay > 0 && !status.m_frozen)
             {
@@ -1598,7 +1712,6 @@ void turn_start_phase(Field* fd)
         }
     }
     // Active player's structure cards:
-    // update index
     // reduce delay
     {
         auto& structures(fd->tap->structures);
@@ -1607,7 +1720,6 @@ void turn_start_phase(Field* fd)
             ++index)
         {
             CardStatus& status(structures[index]);
-            status.m_index = index;
             if(status.m_delay > 0)
             {
                 _DEBUG_MSG(1, "%s reduces its timer\n", status_description(&status).c_str());
@@ -1619,7 +1731,6 @@ void turn_start_phase(Field* fd)
         }
     }
     // Defending player's assault cards:
-    // update index
     // remove augment, chaos, freeze, immobilize, jam, rally, weaken, apply refresh
     // remove temp split
     {
@@ -1629,7 +1740,6 @@ void turn_start_phase(Field* fd)
             ++index)
         {
             CardStatus& status(assaults[index]);
-            status.m_index = index;
             status.m_augmented = 0;
             status.m_chaosed = false;
             status.m_enfeebled = 0;
@@ -1647,9 +1757,9 @@ void turn_start_phase(Field* fd)
                 check_and_perform_refresh(fd, &status);
             }
         }
+        assaults.phased.clear();
     }
     // Defending player's structure cards:
-    // update index
     // apply refresh
     {
         auto& structures(fd->tip->structures);
@@ -1658,19 +1768,14 @@ void turn_start_phase(Field* fd)
             ++index)
         {
             CardStatus& status(structures[index]);
-            status.m_index = index;
-            if(status.m_card->m_refresh && fd->effect != Effect::impenetrable)
+            if(status.m_card->m_refresh && !(Mode::with_effect && fd->effect == Effect::impenetrable))
             {
                 check_and_perform_refresh(fd, &status);
             }
         }
     }
-    // Perform on death skills (from cards killed by poison damage)
-    prepend_on_death(fd);
-    resolve_skill(fd);
-    // Regen from poison
-    check_regeneration(fd);
 }
+template<typename Mode>
 void evaluate_legion(Field* fd)
 {
     // Not subject to Mimic / Emulate / Augment
@@ -1680,14 +1785,14 @@ void evaluate_legion(Field* fd)
     for(fd->current_ci = 0; fd->current_ci < assaults.size(); ++fd->current_ci)
     {
         CardStatus* status(&assaults[fd->current_ci]);
-        unsigned legion_base = fd->effect == Effect::united_front ? status->m_card->m_delay : status->m_card->m_legion;
+        unsigned legion_base = Mode::with_effect && fd->effect == Effect::united_front ? status->m_card->m_delay : status->m_card->m_legion;
         if(legion_base == 0)
         {
             continue;
         }
         unsigned legion_size(0);
         legion_size += status->m_index > 0 && assaults[status->m_index - 1].m_hp > 0 && assaults[status->m_index - 1].m_faction == status->m_faction;
-        legion_size += status->m_index + 1 < assaults.size() && assaults[status->m_index + 1].m_hp > 0 && assaults[status->m_index + 1].m_faction == status->m_faction;
+        legion_size += status->m_index + 1u < assaults.size() && assaults[status->m_index + 1].m_hp > 0 && assaults[status->m_index + 1].m_faction == status->m_faction;
         if(legion_size == 0)
         {
             continue;
@@ -1724,10 +1829,11 @@ inline unsigned counter_damage(CardStatus* att, CardStatus* def)
 }
 inline CardStatus* select_first_enemy_wall(Field* fd)
 {
-    for(unsigned i(0); i < fd->tip->structures.size(); ++i)
+    Board& structures(fd->tip->structures);
+    for(SlotMask walls(structures.walls & structures.alive); !walls.none(); )
     {
-        CardStatus& c(fd->tip->structures[i]);
-        if(c.m_card->m_wall && c.m_hp > 0 && skill_check<wall>(fd, &c, nullptr))
+        CardStatus& c(structures[walls.pop_first()]);
+        if(skill_check<wall>(fd, &c, nullptr))
         {
             count_achievement<wall>(fd, &c);
             return(&c);
@@ -1736,9 +1842,9 @@ inline CardStatus* select_first_enemy_wall(Field* fd)
     return(nullptr);
 }
 
-inline bool alive_assault(Storage<CardStatus>& assaults, unsigned index)
+inline bool alive_assault(Board& assaults, unsigned index)
 {
-    return(assaults.size() > index && assaults[index].m_hp > 0);
+    return(assaults.size() > index && assaults.alive.test(index));
 }
 
 void remove_commander_hp(Field* fd, CardStatus& status, unsigned dmg, bool count_points)
@@ -1778,7 +1884,7 @@ struct PerformAttack
         fd(fd_), att_status(att_status_), def_status(def_status_), att_dmg(0), killed_by_attack(false)
     {}
 
-    template<enum CardType::CardType def_cardtype>
+    template<typename Mode, enum CardType::CardType def_cardtype>
     void op()
     {
         unsigned pre_modifier_dmg = attack_power(att_status);
@@ -1789,7 +1895,7 @@ struct PerformAttack
             remove_corroded(att_status);
             return;
         }
-        count_achievement<attack>(fd, att_status);
+        count_achievement<Mode, attack>(fd, att_status);
         // Evaluation order:
         // assaults only: fly check
         // modify damage
@@ -1800,22 +1906,22 @@ struct PerformAttack
         // counter, berserk
         // assaults only: (crush, leech if still alive)
         // check regeneration
-        if(def_status->m_card->m_flying && (fd->effect == Effect::high_skies || fd->flip()) && skill_check<flying>(fd, def_status, att_status))
+        if(def_status->m_card->m_flying && ((Mode::with_effect && fd->effect == Effect::high_skies) || fd->flip()) && skill_check<flying>(fd, def_status, att_status))
         {
-            count_achievement<flying>(fd, def_status);
+            count_achievement<Mode, flying>(fd, def_status);
             _DEBUG_MSG(1, "%s attacks %s but it dodges with Flying\n", status_description(att_status).c_str(), status_description(def_status).c_str());
             return;
         }
 
-        modify_attack_damage<def_cardtype>(pre_modifier_dmg);
-        if(att_status->m_player == 0)
+        modify_attack_damage<Mode>(pre_modifier_dmg);
+        if(Mode::with_achievement && att_status->m_player == 0)
         {
             fd->update_max_counter(fd->achievement.misc_req, AchievementMiscReq::damage, att_dmg);
         }
 
         // If Impenetrable, prevent attack damage against walls,
         // but still activate Counter!
-        if(att_dmg > 0 && fd->effect == Effect::impenetrable && def_status->m_card->m_wall)
+        if(att_dmg > 0 && Mode::with_effect && fd->effect == Effect::impenetrable && def_status->m_card->m_wall)
         {
             _DEBUG_MSG(1, "%s is impenetrable\n", status_description(def_status).c_str());
             att_dmg = 0;
@@ -1828,21 +1934,21 @@ struct PerformAttack
             damage_dependant_pre_oa<def_cardtype>();
             on_kill<def_cardtype>();
         }
-        on_attacked<def_cardtype>();
+        on_attacked<Mode>();
         if(att_dmg > 0)
         {
             if(att_status->m_hp > 0)
             {
                if(def_status->m_card->m_stun && skill_check<stun>(fd, def_status, att_status))
                 {
-                    count_achievement<stun>(fd, def_status);
+                    count_achievement<Mode, stun>(fd, def_status);
                     // perform_skill_stun
                     _DEBUG_MSG(1, "%s stuns %s\n", status_description(def_status).c_str(), status_description(att_status).c_str());
                     att_status->m_stunned = 2;
                 }
                 if(def_status->m_card->m_counter > 0 && skill_check<counter>(fd, def_status, att_status))
                 {
-                    count_achievement<counter>(fd, def_status);
+                    count_achievement<Mode, counter>(fd, def_status);
                     // perform_skill_counter
                     unsigned counter_dmg(counter_damage(att_status, def_status));
                     _DEBUG_MSG(1, "%s takes %u counter damage from %s\n", status_description(att_status).c_str(), counter_dmg, status_description(def_status).c_str());
@@ -1857,7 +1963,7 @@ struct PerformAttack
                 }
                 if(att_status->m_card->m_berserk > 0 && skill_check<berserk>(fd, att_status, nullptr))
                 {
-                    count_achievement<berserk>(fd, att_status);
+                    count_achievement<Mode, berserk>(fd, att_status);
                     // perform_skill_berserk
                     att_status->m_berserk += att_status->m_card->m_berserk + att_status->m_enhance_berserk;
                 }
@@ -1870,11 +1976,11 @@ struct PerformAttack
         check_regeneration(fd);
     }
 
-    template<enum CardType::CardType>
+    template<typename Mode>
     void modify_attack_damage(unsigned pre_modifier_dmg)
     {
-        const Card& att_card(*att_status->m_card);
-        const Card& def_card(*def_status->m_card);
+        const SimCard& att_card(*att_status->m_card);
+        const SimCard& def_card(*def_status->m_card);
         assert(att_card.m_type == CardType::assault);
         assert(pre_modifier_dmg > 0);
         att_dmg = pre_modifier_dmg;
@@ -1882,19 +1988,19 @@ struct PerformAttack
         std::string desc;
         if(att_card.m_valor > 0 && skill_check<valor>(fd, att_status, nullptr))
         {
-            count_achievement<valor>(fd, att_status);
+            count_achievement<Mode, valor>(fd, att_status);
             if(debug_print) { desc += "+" + to_string(att_card.m_valor) + "(valor)"; }
             att_dmg += att_card.m_valor;
         }
         if(att_card.m_antiair > 0 && skill_check<antiair>(fd, att_status, def_status))
         {
-            count_achievement<antiair>(fd, att_status);
+            count_achievement<Mode, antiair>(fd, att_status);
             if(debug_print) { desc += "+" + to_string(att_card.m_antiair) + "(antiair)"; }
             att_dmg += att_card.m_antiair;
         }
         if(att_card.m_burst > 0 && skill_check<burst>(fd, att_status, def_status))
         {
-            count_achievement<burst>(fd, att_status);
+            count_achievement<Mode, burst>(fd, att_status);
             if(debug_print) { desc += "+" + to_string(att_card.m_burst) + "(burst)"; }
             att_dmg += att_card.m_burst;
         }
@@ -1907,7 +2013,7 @@ struct PerformAttack
         std::string reduced_desc;
         unsigned reduced_dmg(0);
         unsigned armored_value(def_card.m_armored);
-        if(armored_value == 0 && fd->effect == Effect::photon_shield && def_status->m_player == (fd->optimization_mode == OptimizationMode::defense ? 0u : 1u))
+        if(armored_value == 0 && Mode::with_effect && fd->effect == Effect::photon_shield && def_status->m_player == (fd->optimization_mode == OptimizationMode::defense ? 0u : 1u))
         {
             armored_value = 2;
         }
@@ -1916,7 +2022,7 @@ struct PerformAttack
             // Armored counts if not totally cancelled by Pierce. TODO how if Armored + Proteced > Pierce?
             if(armored_value > att_card.m_pierce)
             {
-                count_achievement<armored>(fd, def_status);
+                count_achievement<Mode, armored>(fd, def_status);
             }
             if(debug_print) { reduced_desc += to_string(armored_value) + "(armored)"; }
             reduced_dmg += armored_value;
@@ -1962,36 +2068,36 @@ struct PerformAttack
     template<enum CardType::CardType>
     void on_kill() {}
 
-    template<enum CardType::CardType def_cardtype>
+    template<typename Mode>
     void on_attacked()
     {
         if(def_status->m_card->m_poison_oa > att_status->m_poisoned && skill_check<poison>(fd, def_status, att_status))
         {
-            count_achievement<poison>(fd, def_status);
+            count_achievement<Mode, poison>(fd, def_status);
             unsigned v = def_status->m_card->m_poison_oa;
             _DEBUG_MSG(1, "%s (on attacked) poisons %s by %u\n", status_description(def_status).c_str(), status_description(att_status).c_str(), v);
             att_status->m_poisoned = v;
         }
         if(def_status->m_card->m_disease_oa && skill_check<disease>(fd, def_status, att_status))
         {
-            count_achievement<disease>(fd, def_status);
+            count_achievement<Mode, disease>(fd, def_status);
             // perform_skill_disease
             _DEBUG_MSG(1, "%s (on attacked) diseases %s\n", status_description(def_status).c_str(), status_description(att_status).c_str());
             att_status->m_diseased = true;
         }
         if(def_status->m_hp > 0 && def_status->m_card->m_berserk_oa > 0 && skill_check<berserk>(fd, def_status, nullptr))
         {
-            count_achievement<berserk>(fd, def_status);
+            count_achievement<Mode, berserk>(fd, def_status);
             def_status->m_berserk += def_status->m_card->m_berserk_oa;
         }
         if(def_status->m_card->m_sunder_oa && skill_check<sunder>(fd, def_status, att_status))
         {
-            count_achievement<sunder>(fd, def_status);
+            count_achievement<Mode, sunder>(fd, def_status);
             // perform_skill_sunder
             _DEBUG_MSG(1, "%s (on attacked) sunders %s\n", status_description(def_status).c_str(), status_description(att_status).c_str());
             att_status->m_sundered = true;
         }
-        evaluate_skills(fd, def_status, def_status->m_card->m_skills_on_attacked, SkillMod::on_attacked);
+        evaluate_skills(fd, def_status, def_status->m_card->m_skills_on_attacked);
     }
 
     template<enum CardType::CardType>
@@ -2022,7 +2128,7 @@ void PerformAttack::damage_dependant_pre_oa<CardType::assault>()
     {
         count_achievement<siphon>(fd, att_status);
         // perform_skill_siphon
-        unsigned v = std::min(att_dmg, att_status->m_card->m_siphon);
+        unsigned v = std::min<unsigned>(att_dmg, att_status->m_card->m_siphon);
         _DEBUG_MSG(1, "%s siphons %u health for %s\n", status_description(att_status).c_str(), v, status_description(&fd->tap->commander).c_str());
         add_hp(fd, &fd->tap->commander, v);
     }
@@ -2054,6 +2160,7 @@ void PerformAttack::damage_dependant_pre_oa<CardType::assault>()
         // perform_skill_phase
         _DEBUG_MSG(1, "%s phases %s\n", status_description(att_status).c_str(), status_description(def_status).c_str());
         def_status->m_phased = true;
+        fd->update_masks(def_status);
     }
     if(att_status->m_card->m_inhibit > 0 && skill_check<inhibit>(fd, att_status, def_status))
     {
@@ -2069,7 +2176,7 @@ void PerformAttack::on_kill<CardType::assault>()
 {
     if(killed_by_attack)
     {
-        evaluate_skills(fd, att_status, att_status->m_card->m_skills_on_kill, SkillMod::on_kill);
+        evaluate_skills(fd, att_status, att_status->m_card->m_skills_on_kill);
     }
 }
 
@@ -2095,28 +2202,30 @@ void PerformAttack::crush_leech<CardType::assault>()
     if(att_status->m_card->m_leech > 0 && skill_check<leech>(fd, att_status, nullptr))
     {
         count_achievement<leech>(fd, att_status);
-        _DEBUG_MSG(1, "%s leeches %u health\n", status_description(att_status).c_str(), std::min(att_dmg, att_status->m_card->m_leech + att_status->m_enhance_leech));
-        add_hp(fd, att_status, std::min(att_dmg, att_status->m_card->m_leech + att_status->m_enhance_leech));
+        _DEBUG_MSG(1, "%s leeches %u health\n", status_description(att_status).c_str(), std::min<unsigned>(att_dmg, att_status->m_card->m_leech + att_status->m_enhance_leech));
+        add_hp(fd, att_status, std::min<unsigned>(att_dmg, att_status->m_card->m_leech + att_status->m_enhance_leech));
     }
 }
 
 // General attack phase by the currently evaluated assault, taking into accounts exotic stuff such as flurry,swipe,etc.
+template<typename Mode>
 void attack_commander(Field* fd, CardStatus* att_status)
 {
     CardStatus* def_status{select_first_enemy_wall(fd)}; // defending wall
     if(def_status != nullptr)
     {
-        PerformAttack{fd, att_status, def_status}.op<CardType::structure>();
+        PerformAttack{fd, att_status, def_status}.op<Mode, CardType::structure>();
     }
     else
     {
-        PerformAttack{fd, att_status, &fd->tip->commander}.op<CardType::commander>();
+        PerformAttack{fd, att_status, &fd->tip->commander}.op<Mode, CardType::commander>();
     }
 }
+template<typename Mode>
 void attack_phase(Field* fd)
 {
     CardStatus* att_status(&fd->tap->assaults[fd->current_ci]); // attacking card
-    Storage<CardStatus>& def_assaults(fd->tip->assaults);
+    Board& def_assaults(fd->tip->assaults);
     if(attack_power(att_status) == 0)
     {
         remove_corroded(att_status);
@@ -2129,12 +2238,12 @@ void attack_phase(Field* fd)
     //        See http://www.kongregate.com/forums/65-tyrant/topics/289416?page=22#posts-6861970
     // - 3. attack against the commander or walls (if there is no assault or if the attacker has the fear attribute)
     // Check if attack mode is 1. or 2. (there is a living assault card in front, and no fear)
-    if(alive_assault(def_assaults, fd->current_ci) && !(att_status->m_card->m_fear && skill_check<fear>(fd, att_status, nullptr) && count_achievement<fear>(fd, att_status)))
+    if(alive_assault(def_assaults, fd->current_ci) && !(att_status->m_card->m_fear && skill_check<fear>(fd, att_status, nullptr) && count_achievement<Mode, fear>(fd, att_status)))
     {
         // attack mode 1.
-        if(!(att_status->m_card->m_swipe && skill_check<swipe>(fd, att_status, nullptr) && count_achievement<swipe>(fd, att_status)))
+        if(!(att_status->m_card->m_swipe && skill_check<swipe>(fd, att_status, nullptr) && count_achievement<Mode, swipe>(fd, att_status)))
         {
-            PerformAttack{fd, att_status, &fd->tip->assaults[fd->current_ci]}.op<CardType::assault>();
+            PerformAttack{fd, att_status, &fd->tip->assaults[fd->current_ci]}.op<Mode, CardType::assault>();
         }
         // attack mode 2.
         else
@@ -2144,30 +2253,30 @@ void attack_phase(Field* fd)
             // attack the card on the left
             if(fd->current_ci > 0 && alive_assault(def_assaults, fd->current_ci - 1))
             {
-                PerformAttack{fd, att_status, &fd->tip->assaults[fd->current_ci-1]}.op<CardType::assault>();
+                PerformAttack{fd, att_status, &fd->tip->assaults[fd->current_ci-1]}.op<Mode, CardType::assault>();
             }
             if(fd->end || !can_attack(att_status)) { return; }
             // attack the card in front (or attacks the commander if the card in front is just died)
             if(alive_assault(def_assaults, fd->current_ci))
             {
-                PerformAttack{fd, att_status, &fd->tip->assaults[fd->current_ci]}.op<CardType::assault>();
+                PerformAttack{fd, att_status, &fd->tip->assaults[fd->current_ci]}.op<Mode, CardType::assault>();
             }
             else
             {
-                attack_commander(fd, att_status);
+                attack_commander<Mode>(fd, att_status);
             }
             if(fd->end || !can_attack(att_status)) { return; }
             // attack the card on the right
             if(alive_assault(def_assaults, fd->current_ci + 1))
             {
-                PerformAttack{fd, att_status, &fd->tip->assaults[fd->current_ci+1]}.op<CardType::assault>();
+                PerformAttack{fd, att_status, &fd->tip->assaults[fd->current_ci+1]}.op<Mode, CardType::assault>();
             }
         }
     }
     // attack mode 3.
     else
     {
-        attack_commander(fd, att_status);
+        attack_commander<Mode>(fd, att_status);
     }
 }
 
@@ -2203,7 +2312,7 @@ inline bool skill_predicate(Field* fd, CardStatus* src, CardStatus* c, const Ski
 template<>
 inline bool skill_predicate<augment>(Field* fd, CardStatus* src, CardStatus* c, const SkillSpec& s)
 {
-    const auto& mod = std::get<4>(s);
+    const auto& mod = s.mod;
     if(can_act(c) &&  // (fd->tapi == c->m_player ? is_active(c) && !is_attacking_or_has_attacked(c) : is_active_next_turn(c)))
         (src->m_player != c->m_player || mod == SkillMod::on_death ? (fd->tapi == c->m_player ? is_active(c) && !is_attacking_or_has_attacked(c) : is_active_next_turn(c)) :
          mod == SkillMod::on_attacked ? is_active_next_turn(c) :
@@ -2212,15 +2321,15 @@ inline bool skill_predicate<augment>(Field* fd, CardStatus* src, CardStatus* c,
         for(auto& s: c->m_card->m_skills)
         {
             // Any quantifiable skill except augment
-            if(std::get<1>(s) > 0 && std::get<0>(s) != augment && std::get<0>(s) != summon) { return(true); }
+            if(s.value > 0 && s.id != augment && s.id != summon) { return(true); }
         }
         bool need_add_skill = true;
         auto mod = SkillMod::on_activate;
         if(may_change_skill(fd, c, mod))
         {
-            auto s = apply_battleground_effect(fd, c, SkillSpec(new_skill, 0, allfactions, false, mod), mod, need_add_skill);
-            assert(std::get<0>(s) != new_skill);
-            if(std::get<1>(s) > 0 && std::get<0>(s) != augment && std::get<0>(s) != summon) { return(true); }
+            auto s = apply_battleground_effect(fd->effect, c->m_card, SkillSpec(new_skill, 0, allfactions, false, mod), mod, need_add_skill);
+            assert(s.id != new_skill);
+            if(s.value > 0 && s.id != augment && s.id != summon) { return(true); }
         }
     }
     return(false);
@@ -2229,7 +2338,7 @@ inline bool skill_predicate<augment>(Field* fd, CardStatus* src, CardStatus* c,
 template<>
 inline bool skill_predicate<chaos>(Field* fd, CardStatus* src, CardStatus* c, const SkillSpec& s)
 {
-    const auto& mod = std::get<4>(s);
+    const auto& mod = s.mod;
     return(!c->m_chaosed && can_act(c) &&  // (fd->tapi == c->m_player ? is_active(c) && !is_attacking_or_has_attacked(c) : is_active_next_turn(c)));
             (mod == SkillMod::on_attacked ? is_active(c) && c->m_index > fd->current_ci :
              mod == SkillMod::on_death ? c->m_index >= src->m_index && (fd->tapi != src->m_player ? is_active(c) : is_active_next_turn(c)) :
@@ -2272,7 +2381,7 @@ inline bool skill_predicate<infuse>(Field* fd, CardStatus* src, CardStatus* c, c
 template<>
 inline bool skill_predicate<jam>(Field* fd, CardStatus* src, CardStatus* c, const SkillSpec& s)
 {
-    const auto& mod = std::get<4>(s);
+    const auto& mod = s.mod;
     return( skill_check<jam>(fd, src, c) && can_act(c) &&
             (mod == SkillMod::on_attacked ? is_active(c) && c->m_index > fd->current_ci :
              mod == SkillMod::on_death ? c->m_index >= src->m_index && (fd->tapi != src->m_player ? is_active(c) : is_active_next_turn(c)) :
@@ -2294,7 +2403,7 @@ inline bool skill_predicate<protect>(Field* fd, CardStatus* src, CardStatus* c,
 template<>
 inline bool skill_predicate<rally>(Field* fd, CardStatus* src, CardStatus* c, const SkillSpec& s)
 {
-    const auto& mod = std::get<4>(s);
+    const auto& mod = s.mod;
     return(can_attack(c) && !c->m_sundered &&  // (fd->tapi == c->m_player ? is_active(c) && !is_attacking_or_has_attacked(c) : is_active_next_turn(c)));
         (src->m_player != c->m_player || mod == SkillMod::on_death ? (fd->tapi == c->m_player ? is_active(c) && !is_attacking_or_has_attacked(c) : is_active_next_turn(c)) :
          mod == SkillMod::on_attacked ? is_active_next_turn(c) :
@@ -2324,7 +2433,7 @@ inline bool skill_predicate<supply>(Field* fd, CardStatus* src, CardStatus* c, c
 template<>
 inline bool skill_predicate<weaken>(Field* fd, CardStatus* src, CardStatus* c, const SkillSpec& s)
 {
-    const auto& mod = std::get<4>(s);
+    const auto& mod = s.mod;
     return(can_act(c) && !c->m_immobilized && attack_power(c) > 0 &&  // (fd->tapi == c->m_player ? is_active(c) && !is_attacking_or_has_attacked(c) : is_active_next_turn(c)));
             (mod == SkillMod::on_attacked ? is_active(c) && c->m_index > fd->current_ci :
              mod == SkillMod::on_death ? c->m_index >= src->m_index && (fd->tapi != src->m_player ? is_active(c) : is_active_next_turn(c)) :
@@ -2339,7 +2448,7 @@ template<>
 inline bool skill_predicate<enhance_berserk>(Field* fd, CardStatus* src, CardStatus* c, const SkillSpec& s)
 { 
     //copied and adopted from rally
-    const auto& mod = std::get<4>(s);
+    const auto& mod = s.mod;
     return(c->m_card->m_berserk > 0 && can_attack(c) && !c->m_sundered &&  // (fd->tapi == c->m_player ? is_active(c) && !is_attacking_or_has_attacked(c) : is_active_next_turn(c)));
         (src->m_player != c->m_player || mod == SkillMod::on_death ? (fd->tapi == c->m_player ? is_active(c) && !is_attacking_or_has_attacked(c) : is_active_next_turn(c)) :
          mod == SkillMod::on_attacked ? is_active_next_turn(c) :
@@ -2357,7 +2466,7 @@ inline bool skill_predicate<enhance_counter>(Field* fd, CardStatus* src, CardSta
 template<>
 inline bool skill_predicate<enhance_enfeeble>(Field* fd, CardStatus* src, CardStatus* c, const SkillSpec& s)
 { 
-    const auto& mod = std::get<4>(s);
+    const auto& mod = s.mod;
     return(c->m_card->m_enfeeble > 0 && can_attack(c) && !c->m_sundered &&  // (fd->tapi == c->m_player ? is_active(c) && !is_attacking_or_has_attacked(c) : is_active_next_turn(c)));
         (src->m_player != c->m_player || mod == SkillMod::on_death ? (fd->tapi == c->m_player ? is_active(c) && !is_attacking_or_has_attacked(c) : is_active_next_turn(c)) :
          mod == SkillMod::on_attacked ? is_active_next_turn(c) :
@@ -2372,7 +2481,7 @@ template<>
 inline bool skill_predicate<enhance_heal>(Field* fd, CardStatus* src, CardStatus* c, const SkillSpec& s)
 { 
     //copied and adopted from rally
-    const auto& mod = std::get<4>(s);
+    const auto& mod = s.mod;
     return(c->m_card->m_heal > 0 && can_attack(c) && !c->m_sundered &&  // (fd->tapi == c->m_player ? is_active(c) && !is_attacking_or_has_attacked(c) : is_active_next_turn(c)));
         (src->m_player != c->m_player || mod == SkillMod::on_death ? (fd->tapi == c->m_player ? is_active(c) && !is_attacking_or_has_attacked(c) : is_active_next_turn(c)) :
          mod == SkillMod::on_attacked ? is_active_next_turn(c) :
@@ -2383,7 +2492,7 @@ template<>
 inline bool skill_predicate<enhance_leech>(Field* fd, CardStatus* src, CardStatus* c, const SkillSpec& s)
 { 
     //copied and adopted from rally
-    const auto& mod = std::get<4>(s);
+    const auto& mod = s.mod;
     return(c->m_card->m_leech > 0 && can_attack(c) && !c->m_sundered &&  // (fd->tapi == c->m_player ? is_active(c) && !is_attacking_or_has_attacked(c) : is_active_next_turn(c)));
         (src->m_player != c->m_player || mod == SkillMod::on_death ? (fd->tapi == c->m_player ? is_active(c) && !is_attacking_or_has_attacked(c) : is_active_next_turn(c)) :
          mod == SkillMod::on_attacked ? is_active_next_turn(c) :
@@ -2394,7 +2503,7 @@ template<>
 inline bool skill_predicate<enhance_poison>(Field* fd, CardStatus* src, CardStatus* c, const SkillSpec& s)
 { 
     //copied and adopted from rally
-    const auto& mod = std::get<4>(s);
+    const auto& mod = s.mod;
     return(c->m_card->m_poison > 0 && can_attack(c) && !c->m_sundered &&  // (fd->tapi == c->m_player ? is_active(c) && !is_attacking_or_has_attacked(c) : is_active_next_turn(c)));
         (src->m_player != c->m_player || mod == SkillMod::on_death ? (fd->tapi == c->m_player ? is_active(c) && !is_attacking_or_has_attacked(c) : is_active_next_turn(c)) :
          mod == SkillMod::on_attacked ? is_active_next_turn(c) :
@@ -2404,7 +2513,7 @@ inline bool skill_predicate<enhance_poison>(Field* fd, CardStatus* src, CardStat
 template<>
 inline bool skill_predicate<enhance_rally>(Field* fd, CardStatus* src, CardStatus* c, const SkillSpec& s)
 {
-    const auto& mod = std::get<4>(s);
+    const auto& mod = s.mod;
     //do we need to make sure that the card has rally? if so, how :)
     return(c->m_card->m_rally>0 && can_attack(c) && !c->m_sundered &&  // (fd->tapi == c->m_player ? is_active(c) && !is_attacking_or_has_attacked(c) : is_active_next_turn(c)));
         (src->m_player != c->m_player || mod == SkillMod::on_death ? (fd->tapi == c->m_player ? is_active(c) && !is_attacking_or_has_attacked(c) : is_active_next_turn(c)) :
@@ -2416,7 +2525,7 @@ template<>
 inline bool skill_predicate<enhance_strike>(Field* fd, CardStatus* src, CardStatus* c, const SkillSpec& s)
 {
     //copied and adopted from rally
-    const auto& mod = std::get<4>(s);
+    const auto& mod = s.mod;
     return(c->m_card->m_strike > 0 && can_attack(c) && !c->m_sundered &&  // (fd->tapi == c->m_player ? is_active(c) && !is_attacking_or_has_attacked(c) : is_active_next_turn(c)));
         (src->m_player != c->m_player || mod == SkillMod::on_death ? (fd->tapi == c->m_player ? is_active(c) && !is_attacking_or_has_attacked(c) : is_active_next_turn(c)) :
          mod == SkillMod::on_attacked ? is_active_next_turn(c) :
@@ -2483,6 +2592,7 @@ inline void perform_skill<infuse>(Field* fd, CardStatus* c, unsigned v)
 {
     c->m_faction = bloodthirsty;
     c->m_infused = true;
+    fd->update_masks(c);
 }
 
 template<>
@@ -2620,111 +2730,160 @@ inline void perform_skill<enhance_strike>(Field* fd, CardStatus* c, unsigned v)
     c->m_enhance_strike += v;
 }
     
+// The cards of a board that the predicate of a skill may hold for: the living ones for most skills.
 template<unsigned skill_id>
-inline unsigned select_fast(Field* fd, CardStatus* src_status, const std::vector<CardStatus*>& cards, const SkillSpec& s, bool is_helpful_skill)
+inline SlotMask skill_candidates(const Board& cards)
+{ return(cards.alive); }
+
+template<>
+inline SlotMask skill_candidates<enhance_armored>(const Board& cards)
+{ return(cards.occupied()); }
+
+template<>
+inline SlotMask skill_candidates<enhance_corrosive>(const Board& cards)
+{ return(cards.occupied()); }
+
+template<>
+inline SlotMask skill_candidates<enhance_counter>(const Board& cards)
+{ return(cards.occupied()); }
+
+template<>
+inline SlotMask skill_candidates<enhance_evade>(const Board& cards)
+{ return(cards.occupied()); }
+
+template<>
+inline SlotMask skill_candidates<infuse>(const Board& cards)
+{ return(cards.occupied() & ~cards.factions[bloodthirsty]); }
+
+template<>
+inline SlotMask skill_candidates<rush>(const Board& cards)
+{ return(cards.occupied()); }
+
+// Whether skill_candidates() are exactly the cards that the predicate of the skill holds for.
+template<unsigned skill_id>
+constexpr bool skill_predicate_is_mask()
+{ return(skill_id == enfeeble || skill_id == infuse || skill_id == mimic || skill_id == protect || skill_id == siege || skill_id == strike); }
+
+template<unsigned skill_id>
+inline unsigned select_targets(Field* fd, CardStatus* src_status, Board& cards, SlotMask candidates, const SkillSpec& s, bool is_helpful_skill)
 {
-    if(std::get<2>(s) == allfactions || fd->effect == Effect::bg_progenitor)
+    candidates &= skill_candidates<skill_id>(cards);
+    if(is_helpful_skill)
     {
-        return(fd->make_selection_array(cards.begin(), cards.end(), [fd, src_status, s, is_helpful_skill](CardStatus* c){return(!(is_helpful_skill && c->m_phased) && skill_predicate<skill_id>(fd, src_status, c, s));}));
+        candidates &= ~cards.phased;
+    }
+    if(skill_predicate_is_mask<skill_id>())
+    {
+        return(fd->select(cards, candidates));
+    }
+    return(fd->select(cards, candidates, [fd, src_status, s](CardStatus* c){return(skill_predicate<skill_id>(fd, src_status, c, s));}));
+}
+
+template<unsigned skill_id>
+inline unsigned select_fast(Field* fd, CardStatus* src_status, Board& cards, const SkillSpec& s, bool is_helpful_skill)
+{
+    if(s.faction == allfactions || fd->effect == Effect::bg_progenitor)
+    {
+        return(select_targets<skill_id>(fd, src_status, cards, cards.occupied(), s, is_helpful_skill));
     }
     else
     {
-        return(fd->make_selection_array(cards.begin(), cards.end(), [fd, src_status, s, is_helpful_skill](CardStatus* c){return( (c->m_faction == Faction::progenitor || c->m_faction == std::get<2>(s)) && !(is_helpful_skill && c->m_phased) && skill_predicate<skill_id>(fd, src_status, c, s));}));
+        return(select_targets<skill_id>(fd, src_status, cards, cards.factions[progenitor] | cards.factions[s.faction], s, is_helpful_skill));
     }
 }
 
 template<>
-inline unsigned select_fast<supply>(Field* fd, CardStatus* src_status, const std::vector<CardStatus*>& cards, const SkillSpec& s, bool is_helpful_skill)
+inline unsigned select_fast<supply>(Field* fd, CardStatus* src_status, Board& cards, const SkillSpec& s, bool is_helpful_skill)
 {
     // mimiced supply by a structure, etc ?
     if(!(src_status->m_card->m_type == CardType::assault)) { return(0); }
     const unsigned min_index(src_status->m_index - (src_status->m_index == 0 ? 0 : 1));
     const unsigned max_index(src_status->m_index + (src_status->m_index == cards.size() - 1 ? 0 : 1));
-    return(fd->make_selection_array(cards.begin() + min_index, cards.begin() + max_index + 1, [fd, src_status, s, is_helpful_skill](CardStatus* c){return(!(is_helpful_skill && c->m_phased) && skill_predicate<supply>(fd, src_status, c, s));}));
+    return(select_targets<supply>(fd, src_status, cards, SlotMask::below(max_index + 1) & ~SlotMask::below(min_index), s, is_helpful_skill));
 }
 
-inline std::vector<CardStatus*>& skill_targets_hostile_assault(Field* fd, CardStatus* src_status)
+inline Board& skill_targets_hostile_assault(Field* fd, CardStatus* src_status)
 {
-    return(fd->players[src_status->m_chaosed ? src_status->m_player : opponent(src_status->m_player)]->assaults.m_indirect);
+    return(fd->players[src_status->m_chaosed ? src_status->m_player : opponent(src_status->m_player)]->assaults);
 }
 
-inline std::vector<CardStatus*>& skill_targets_allied_assault(Field* fd, CardStatus* src_status)
+inline Board& skill_targets_allied_assault(Field* fd, CardStatus* src_status)
 {
-    return(fd->players[src_status->m_player]->assaults.m_indirect);
+    return(fd->players[src_status->m_player]->assaults);
 }
 
-inline std::vector<CardStatus*>& skill_targets_hostile_structure(Field* fd, CardStatus* src_status)
+inline Board& skill_targets_hostile_structure(Field* fd, CardStatus* src_status)
 {
-    return(fd->players[src_status->m_chaosed ? src_status->m_player : opponent(src_status->m_player)]->structures.m_indirect);
+    return(fd->players[src_status->m_chaosed ? src_status->m_player : opponent(src_status->m_player)]->structures);
 }
 
-inline std::vector<CardStatus*>& skill_targets_allied_structure(Field* fd, CardStatus* src_status)
+inline Board& skill_targets_allied_structure(Field* fd, CardStatus* src_status)
 {
-    return(fd->players[src_status->m_player]->structures.m_indirect);
+    return(fd->players[src_status->m_player]->structures);
 }
 
 template<unsigned skill>
-std::vector<CardStatus*>& skill_targets(Field* fd, CardStatus* src_status)
+Board& skill_targets(Field* fd, CardStatus* src_status)
 {
     std::cerr << "skill_targets: Error: no specialization for " << skill_names[skill] << "\n";
     throw;
 }
 
-template<> inline std::vector<CardStatus*>& skill_targets<augment>(Field* fd, CardStatus* src_status)
+template<> inline Board& skill_targets<augment>(Field* fd, CardStatus* src_status)
 { return(skill_targets_allied_assault(fd, src_status)); }
 
-template<> std::vector<CardStatus*>& skill_targets<chaos>(Field* fd, CardStatus* src_status)
+template<> Board& skill_targets<chaos>(Field* fd, CardStatus* src_status)
 { return(skill_targets_hostile_assault(fd, src_status)); }
 
-template<> std::vector<CardStatus*>& skill_targets<cleanse>(Field* fd, CardStatus* src_status)
+template<> Board& skill_targets<cleanse>(Field* fd, CardStatus* src_status)
 { return(skill_targets_allied_assault(fd, src_status)); }
 
-template<> std::vector<CardStatus*>& skill_targets<enfeeble>(Field* fd, CardStatus* src_status)
+template<> Board& skill_targets<enfeeble>(Field* fd, CardStatus* src_status)
 { return(skill_targets_hostile_assault(fd, src_status)); }
 
-template<> std::vector<CardStatus*>& skill_targets<enhance_armored>(Field* fd, CardStatus* src_status)
+template<> Board& skill_targets<enhance_armored>(Field* fd, CardStatus* src_status)
 { return(skill_targets_allied_assault(fd, src_status)); }
 
-template<> std::vector<CardStatus*>& skill_targets<enhance_berserk>(Field* fd, CardStatus* src_status)
+template<> Board& skill_targets<enhance_berserk>(Field* fd, CardStatus* src_status)
 { return(skill_targets_allied_assault(fd, src_status)); }
 
-template<> std::vector<CardStatus*>& skill_targets<enhance_corrosive>(Field* fd, CardStatus* src_status)
+template<> Board& skill_targets<enhance_corrosive>(Field* fd, CardStatus* src_status)
 { return(skill_targets_allied_assault(fd, src_status)); }
 
-template<> std::vector<CardStatus*>& skill_targets<enhance_counter>(Field* fd, CardStatus* src_status)
+template<> Board& skill_targets<enhance_counter>(Field* fd, CardStatus* src_status)
 { return(skill_targets_allied_assault(fd, src_status)); }
 
-template<> std::vector<CardStatus*>& skill_targets<enhance_enfeeble>(Field* fd, CardStatus* src_status)
+template<> Board& skill_targets<enhance_enfeeble>(Field* fd, CardStatus* src_status)
 { return(skill_targets_allied_assault(fd, src_status)); }
 
-template<> std::vector<CardStatus*>& skill_targets<enhance_evade>(Field* fd, CardStatus* src_status)
+template<> Board& skill_targets<enhance_evade>(Field* fd, CardStatus* src_status)
 { return(skill_targets_allied_assault(fd, src_status)); }
 
-template<> std::vector<CardStatus*>& skill_targets<enhance_heal>(Field* fd, CardStatus* src_status)
+template<> Board& skill_targets<enhance_heal>(Field* fd, CardStatus* src_status)
 { return(skill_targets_allied_assault(fd, src_status)); }
 
-template<> std::vector<CardStatus*>& skill_targets<enhance_leech>(Field* fd, CardStatus* src_status)
+template<> Board& skill_targets<enhance_leech>(Field* fd, CardStatus* src_status)
 { return(skill_targets_allied_assault(fd, src_status)); }
 
-template<> std::vector<CardStatus*>& skill_targets<enhance_poison>(Field* fd, CardStatus* src_status)
+template<> Board& skill_targets<enhance_poison>(Field* fd, CardStatus* src_status)
 { return(skill_targets_allied_assault(fd, src_status)); }
 
-template<> std::vector<CardStatus*>& skill_targets<enhance_rally>(Field* fd, CardStatus* src_status)
+template<> Board& skill_targets<enhance_rally>(Field* fd, CardStatus* src_status)
 { return(skill_targets_allied_assault(fd, src_status)); }
 
-template<> std::vector<CardStatus*>& skill_targets<enhance_strike>(Field* fd, CardStatus* src_status)
+template<> Board& skill_targets<enhance_strike>(Field* fd, CardStatus* src_status)
 { return(skill_targets_allied_assault(fd, src_status)); }
 
-template<> std::vector<CardStatus*>& skill_targets<freeze>(Field* fd, CardStatus* src_status)
+template<> Board& skill_targets<freeze>(Field* fd, CardStatus* src_status)
 { return(skill_targets_hostile_assault(fd, src_status)); }
 
-template<> std::vector<CardStatus*>& skill_targets<heal>(Field* fd, CardStatus* src_status)
+template<> Board& skill_targets<heal>(Field* fd, CardStatus* src_status)
 { return(skill_targets_allied_assault(fd, src_status)); }
 
-template<> std::vector<CardStatus*>& skill_targets<jam>(Field* fd, CardStatus* src_status)
+template<> Board& skill_targets<jam>(Field* fd, CardStatus* src_status)
 { return(skill_targets_hostile_assault(fd, src_status)); }
 
-template<> std::vector<CardStatus*>& skill_targets<mimic>(Field* fd, CardStatus* src_status)
+template<> Board& skill_targets<mimic>(Field* fd, CardStatus* src_status)
 {
     if(fd->effect == Effect::copycat)
     { return(skill_targets_allied_assault(fd, src_status)); }
@@ -2732,31 +2891,31 @@ template<> std::vector<CardStatus*>& skill_targets<mimic>(Field* fd, CardStatus*
     { return(skill_targets_hostile_assault(fd, src_status)); }
 }
 
-template<> std::vector<CardStatus*>& skill_targets<overload>(Field* fd, CardStatus* src_status)
+template<> Board& skill_targets<overload>(Field* fd, CardStatus* src_status)
 { return(skill_targets_hostile_assault(fd, src_status)); }
 
-template<> std::vector<CardStatus*>& skill_targets<protect>(Field* fd, CardStatus* src_status)
+template<> Board& skill_targets<protect>(Field* fd, CardStatus* src_status)
 { return(skill_targets_allied_assault(fd, src_status)); }
 
-template<> std::vector<CardStatus*>& skill_targets<rally>(Field* fd, CardStatus* src_status)
+template<> Board& skill_targets<rally>(Field* fd, CardStatus* src_status)
 { return(skill_targets_allied_assault(fd, src_status)); }
 
-template<> std::vector<CardStatus*>& skill_targets<repair>(Field* fd, CardStatus* src_status)
+template<> Board& skill_targets<repair>(Field* fd, CardStatus* src_status)
 { return(skill_targets_allied_structure(fd, src_status)); }
 
-template<> std::vector<CardStatus*>& skill_targets<rush>(Field* fd, CardStatus* src_status)
+template<> Board& skill_targets<rush>(Field* fd, CardStatus* src_status)
 { return(skill_targets_allied_assault(fd, src_status)); }
 
-template<> std::vector<CardStatus*>& skill_targets<strike>(Field* fd, CardStatus* src_status)
+template<> Board& skill_targets<strike>(Field* fd, CardStatus* src_status)
 { return(skill_targets_hostile_assault(fd, src_status)); }
 
-template<> std::vector<CardStatus*>& skill_targets<supply>(Field* fd, CardStatus* src_status)
+template<> Board& skill_targets<supply>(Field* fd, CardStatus* src_status)
 { return(skill_targets_allied_assault(fd, src_status)); }
 
-template<> std::vector<CardStatus*>& skill_targets<weaken>(Field* fd, CardStatus* src_status)
+template<> Board& skill_targets<weaken>(Field* fd, CardStatus* src_status)
 { return(skill_targets_hostile_assault(fd, src_status)); }
 
-template<> std::vector<CardStatus*>& skill_targets<siege>(Field* fd, CardStatus* src_status)
+template<> Board& skill_targets<siege>(Field* fd, CardStatus* src_status)
 { return(skill_targets_hostile_structure(fd, src_status)); }
 
 template<typename T>
@@ -2767,38 +2926,41 @@ void maybeTriggerRegen(Field* fd)
 template<>
 void maybeTriggerRegen<true_>(Field* fd)
 {
-    fd->skill_queue.emplace_front(nullptr, std::make_tuple(trigger_regen, 0, allfactions, false, SkillMod::on_activate));
+    fd->skill_queue.emplace_front(nullptr, SkillSpec(trigger_regen, 0, allfactions, false, SkillMod::on_activate));
 }
 
+// index: the slot of the target in the selection
 CardStatus* select_interceptable(Field* fd, CardStatus* src_status, unsigned index)
 {
-    CardStatus* status(fd->selection_array[index]);
+    CardStatus* status(fd->selected(index));
     // do not intercept skills from allied units (Chaosed / Infuse)
     if(src_status->m_player == status->m_player)
     {
-        return(fd->selection_array[index]);
+        return(status);
     }
-    if(index > 0)
+    unsigned left_index(fd->selection.prev(index));
+    if(left_index < SlotMask::num_slots)
     {
-        CardStatus* left_status(fd->selection_array[index - 1]);
+        CardStatus* left_status(fd->selected(left_index));
         if(left_status->m_card->m_intercept && left_status->m_index == status->m_index - 1 && left_status->m_player == status->m_player && skill_check<intercept>(fd, left_status, status))
         {
             count_achievement<intercept>(fd, left_status);
             _DEBUG_MSG(1, "%s intercepts for %s\n", status_description(left_status).c_str(), status_description(status).c_str());
-            return(fd->selection_array[index - 1]);
+            return(left_status);
         }
     }
-    if(index + 1 < fd->selection_array.size())
+    unsigned right_index(fd->selection.next(index));
+    if(right_index < SlotMask::num_slots)
     {
-        CardStatus* right_status(fd->selection_array[index + 1]);
+        CardStatus* right_status(fd->selected(right_index));
         if(right_status->m_card->m_intercept && right_status->m_index == status->m_index + 1 && right_status->m_player == status->m_player && skill_check<intercept>(fd, right_status, status))
         {
             count_achievement<intercept>(fd, right_status);
             _DEBUG_MSG(1, "%s intercepts for %s\n", status_description(right_status).c_str(), status_description(status).c_str());
-            return(fd->selection_array[index + 1]);
+            return(right_status);
         }
     }
-    return(fd->selection_array[index]);
+    return(status);
 }
 
 template<Skill skill_id>
@@ -2810,14 +2972,14 @@ bool check_and_perform_skill(Field* fd, CardStatus* src_status, CardStatus* dst_
         if(dst_status->m_inhibited > 0 && dst_status->m_player == src_status->m_player)
         {
             count_achievement<inhibit>(fd, dst_status);
-            _DEBUG_MSG(1, "%s %s (%u) on %s but it is inhibited\n", status_description(src_status).c_str(), skill_names[skill_id].c_str(), std::get<1>(s), status_description(dst_status).c_str());
+            _DEBUG_MSG(1, "%s %s (%u) on %s but it is inhibited\n", status_description(src_status).c_str(), skill_names[skill_id].c_str(), s.value, status_description(dst_status).c_str());
             --dst_status->m_inhibited;
             return(false);
         }   
         if(is_evadable && dst_status->m_card->m_evade > 0 && dst_status->m_evades_left > 0 && skill_check<evade>(fd, dst_status, src_status))
         {
             count_achievement<evade>(fd, dst_status);
-            _DEBUG_MSG(1, "%s %s (%u) on %s but it evades\n", status_description(src_status).c_str(), skill_names[skill_id].c_str(), std::get<1>(s), status_description(dst_status).c_str());
+            _DEBUG_MSG(1, "%s %s (%u) on %s but it evades\n", status_description(src_status).c_str(), skill_names[skill_id].c_str(), s.value, status_description(dst_status).c_str());
             --dst_status->m_evades_left;
             return(false);
         }
@@ -2829,7 +2991,7 @@ bool check_and_perform_skill(Field* fd, CardStatus* src_status, CardStatus* dst_
         //general problem for all enhanced hostile targeted skills like strike (not damage dependent like poison)
         //Ugly enhance strike is added here
         //same is true for enhance_heal and enhance_rally - https://github.com/zachanassian/tu_optimize/issues/44
-        unsigned skill_value(std::get<1>(s));
+        unsigned skill_value(s.value);
         switch(skill_id)
         {
             case enfeeble:
@@ -2854,7 +3016,7 @@ bool check_and_perform_skill(Field* fd, CardStatus* src_status, CardStatus* dst_
     return(false);
 }
 
-//special implementation needed, because standard perform_skill<skill_id>(fd, dst_status, std::get<1>(s)); only allows to alter dst_status
+//special implementation needed, because standard perform_skill<skill_id>(fd, dst_status, s.value); only allows to alter dst_status
 //but jam has to change src_status as well (*1*)
 template<>
 bool check_and_perform_skill<jam>(Field* fd, CardStatus* src_status, CardStatus* dst_status, const SkillSpec& s, bool is_evadable, bool is_count_achievement)
@@ -2864,7 +3026,7 @@ bool check_and_perform_skill<jam>(Field* fd, CardStatus* src_status, CardStatus*
         if(is_evadable && dst_status->m_card->m_evade > 0 && dst_status->m_evades_left > 0 && skill_check<evade>(fd, dst_status, src_status))
         {
             count_achievement<evade>(fd, dst_status);
-            _DEBUG_MSG(1, "%s %s (%u) on %s but it evades\n", status_description(src_status).c_str(), skill_names[jam].c_str(), std::get<1>(s), status_description(dst_status).c_str());
+            _DEBUG_MSG(1, "%s %s (%u) on %s but it evades\n", status_description(src_status).c_str(), skill_names[jam].c_str(), s.value, status_description(dst_status).c_str());
             --dst_status->m_evades_left;
             return(false);
         }
@@ -2873,7 +3035,7 @@ bool check_and_perform_skill<jam>(Field* fd, CardStatus* src_status, CardStatus*
             count_achievement<jam>(fd, src_status);
         }
         _DEBUG_MSG(1, "%s jams %s\n", status_description(src_status).c_str(), status_description(dst_status).c_str());
-        perform_skill<jam>(fd, dst_status, std::get<1>(s));
+        perform_skill<jam>(fd, dst_status, s.value);
         src_status->m_has_jammed = true; //(*1*) m_has_jammed
         return(true);
     }
@@ -2898,7 +3060,7 @@ bool check_and_perform_recharge(Field* fd, CardStatus* src_status)
     {
         count_achievement<recharge>(fd, src_status);
         _DEBUG_MSG(1, "%s activates Recharge\n", status_description(src_status).c_str());
-        fd->tap->deck->place_at_bottom(src_status->m_card);
+        fd->tap->deck->place_at_bottom(src_status->m_card->m_info);
         return(true);
     }
     return(false);
@@ -2919,33 +3081,33 @@ bool check_and_perform_refresh(Field* fd, CardStatus* src_status)
 template<Skill skill_id>
 void perform_targetted_hostile_fast(Field* fd, CardStatus* src_status, const SkillSpec& s)
 {
-    std::vector<CardStatus*>& cards(skill_targets<skill_id>(fd, src_status));
+    Board& cards(skill_targets<skill_id>(fd, src_status));
     if(select_fast<skill_id>(fd, src_status, cards, s, false) == 0)
     {
         return;
     }
     _DEBUG_SELECTION("%s", skill_names[skill_id].c_str());
-    unsigned index_start, index_end;
-    if(std::get<3>(s)) // target all
+    SlotMask targets;
+    if(s.all) // target all
     {
-        index_start = 0;
-        index_end = fd->selection_array.size() - 1;
+        targets = fd->selection;
     }
     else
     {
-        index_start = index_end = fd->rand(0, fd->selection_array.size() - 1);
+        targets.set(select_random(fd));
     }
     bool is_count_achievement(true);
     bool is_evadeable(true);
     if(skill_id == overload) {is_evadeable = false;}
-    for(unsigned s_index(index_start); s_index <= index_end; ++s_index)
+    while(!targets.none())
     {
+        unsigned index(targets.pop_first());
         if(!skill_roll<skill_id>(fd))
         {
-            _DEBUG_MSG(2, "%s misses the 50%% chance to activate %s (%u) on %s\n", status_description(src_status).c_str(), skill_names[skill_id].c_str(), std::get<1>(s), status_description(fd->selection_array[s_index]).c_str());
+            _DEBUG_MSG(2, "%s misses the 50%% chance to activate %s (%u) on %s\n", status_description(src_status).c_str(), skill_names[skill_id].c_str(), s.value, status_description(&cards[index]).c_str());
             continue;
         }
-        CardStatus* c(std::get<3>(s) ? fd->selection_array[s_index] : select_interceptable(fd, src_status, s_index));
+        CardStatus* c(s.all ? &cards[index] : select_interceptable(fd, src_status, index));
         if(check_and_perform_skill<skill_id>(fd, src_status, c, s, is_evadeable, is_count_achievement))
         {
             // Count at most once even targeting "All"
@@ -2954,8 +3116,8 @@ void perform_targetted_hostile_fast(Field* fd, CardStatus* src_status, const Ski
             if(c->m_card->m_payback && skill_predicate<skill_id>(fd, src_status, src_status, s) && fd->flip() && skill_check<payback>(fd, c, src_status) && skill_check<skill_id>(fd, src_status, c))
             {
                 count_achievement<payback>(fd, c);
-                _DEBUG_MSG(1, "%s paybacks (%s %u) on %s\n", status_description(c).c_str(), skill_names[skill_id].c_str(), std::get<1>(s), status_description(src_status).c_str());
-                perform_skill<skill_id>(fd, src_status, std::get<1>(s));
+                _DEBUG_MSG(1, "%s paybacks (%s %u) on %s\n", status_description(c).c_str(), skill_names[skill_id].c_str(), s.value, status_description(src_status).c_str());
+                perform_skill<skill_id>(fd, src_status, s.value);
             }
         }
     }
@@ -2973,8 +3135,8 @@ inline void check_and_perform_emulate(Field* fd, CardStatus* src_status, CardSta
         if(emulator.m_card->m_emulate && skill_predicate<skill_id>(fd, src_status, &emulator, s) && skill_check<emulate>(fd, &emulator, nullptr))
         {
             count_achievement<emulate>(fd, &emulator);
-            _DEBUG_MSG(1, "Emulate (%s %u) on %s\n", skill_names[skill_id].c_str(), std::get<1>(s), status_description(&emulator).c_str());
-            perform_skill<skill_id>(fd, &emulator, std::get<1>(s));
+            _DEBUG_MSG(1, "Emulate (%s %u) on %s\n", skill_names[skill_id].c_str(), s.value, status_description(&emulator).c_str());
+            perform_skill<skill_id>(fd, &emulator, s.value);
         }
     }
 }
@@ -2982,32 +3144,32 @@ inline void check_and_perform_emulate(Field* fd, CardStatus* src_status, CardSta
 template<Skill skill_id>
 void perform_targetted_allied_fast(Field* fd, CardStatus* src_status, const SkillSpec& s)
 {
-    std::vector<CardStatus*>& cards(skill_targets<skill_id>(fd, src_status));
+    Board& cards(skill_targets<skill_id>(fd, src_status));
     if(select_fast<skill_id>(fd, src_status, cards, s, true) == 0)
     {
         return;
     }
     _DEBUG_SELECTION("%s", skill_names[skill_id].c_str());
-    unsigned index_start, index_end;
-    if(std::get<3>(s) || skill_id == supply) // target all or supply
+    SlotMask targets;
+    if(s.all || skill_id == supply) // target all or supply
     {
-        index_start = 0;
-        index_end = fd->selection_array.size() - 1;
+        targets = fd->selection;
     }
     else
     {
-        index_start = index_end = fd->rand(0, fd->selection_array.size() - 1);
+        targets.set(select_random(fd));
     }
     bool is_count_achievement(true);
-    for(unsigned s_index(index_start); s_index <= index_end; ++s_index)
+    while(!targets.none())
     {
+        unsigned index(targets.pop_first());
         // So far no friendly activation skill needs to roll 50% but check it for completeness.
         if(!skill_roll<skill_id>(fd))
         {
-            _DEBUG_MSG(2, "%s misses the 50%% chance to %s (%u) on %s\n", status_description(src_status).c_str(), skill_names[skill_id].c_str(), std::get<1>(s), status_description(fd->selection_array[s_index]).c_str());
+            _DEBUG_MSG(2, "%s misses the 50%% chance to %s (%u) on %s\n", status_description(src_status).c_str(), skill_names[skill_id].c_str(), s.value, status_description(&cards[index]).c_str());
             continue;
         }
-        CardStatus* c(fd->selection_array[s_index]);
+        CardStatus* c(&cards[index]);
         if(check_and_perform_skill<skill_id>(fd, src_status, c, s, false, is_count_achievement))
         {
             // Count at most once even targeting "All"
@@ -3016,8 +3178,8 @@ void perform_targetted_allied_fast(Field* fd, CardStatus* src_status, const Skil
             if(c->m_card->m_tribute && skill_predicate<skill_id>(fd, src_status, src_status, s) && fd->flip() && skill_check<tribute>(fd, c, src_status))
             {
                 count_achievement<tribute>(fd, c);
-                _DEBUG_MSG(1, "Tribute (%s %u) on %s\n", skill_names[skill_id].c_str(), std::get<1>(s), status_description(src_status).c_str());
-                perform_skill<skill_id>(fd, src_status, std::get<1>(s));
+                _DEBUG_MSG(1, "Tribute (%s %u) on %s\n", skill_names[skill_id].c_str(), s.value, status_description(src_status).c_str());
+                perform_skill<skill_id>(fd, src_status, s.value);
                 check_and_perform_emulate<skill_id>(fd, src_status, src_status, s);
             }
             check_and_perform_emulate<skill_id>(fd, src_status, c, s);
@@ -3030,13 +3192,27 @@ void perform_backfire(Field* fd, CardStatus* src_status, const SkillSpec& s)
     check_and_perform_skill<backfire>(fd, src_status, &fd->players[src_status->m_player]->commander, s, false, true);
 }
 
+// Targets the assaults of both players: the active player's ones first, as if in one selection.
 void perform_infuse(Field* fd, CardStatus* src_status, const SkillSpec& s)
 {
-    const auto &cards = boost::join(fd->tap->assaults.m_indirect, fd->tip->assaults.m_indirect);
-    if(fd->make_selection_array(cards.begin(), cards.end(), [fd, s](CardStatus* c){return(skill_predicate<infuse>(fd, &fd->tap->commander, c, s));}) > 0)
+    SlotMask tap_targets(skill_candidates<infuse>(fd->tap->assaults));
+    SlotMask tip_targets(skill_candidates<infuse>(fd->tip->assaults));
+    unsigned num_tap_targets(tap_targets.count());
+    unsigned num_targets(num_tap_targets + tip_targets.count());
+    if(num_targets > 0)
     {
+        unsigned n(fd->rand(0, num_targets - 1));
+        if(n < num_tap_targets)
+        {
+            fd->select(fd->tap->assaults, tap_targets);
+        }
+        else
+        {
+            fd->select(fd->tip->assaults, tip_targets);
+            n -= num_tap_targets;
+        }
         _DEBUG_SELECTION("%s", skill_names[infuse].c_str());
-        CardStatus* c(select_interceptable(fd, src_status, fd->rand(0, fd->selection_array.size() - 1)));
+        CardStatus* c(select_interceptable(fd, src_status, fd->selection.nth(n)));
         check_and_perform_skill<infuse>(fd, src_status, c, s, true, true);
     }
 }
@@ -3060,14 +3236,14 @@ void perform_summon(Field* fd, CardStatus* src_status, const SkillSpec& s);
 
 void perform_split(Field* fd, CardStatus* src_status, const SkillSpec& s)
 {
-    perform_summon<split>(fd, src_status, SkillSpec(summon, src_status->m_card->m_id, std::get<2>(s), std::get<3>(s), std::get<4>(s)));
+    perform_summon<split>(fd, src_status, SkillSpec(summon, src_status->m_card->m_id, s.faction, s.all, s.mod));
 }
 
 template<Skill skill_id>
 void perform_summon(Field* fd, CardStatus* src_status, const SkillSpec& s)
 {
     unsigned player = src_status->m_player;
-    const auto& mod = std::get<4>(s);
+    const auto& mod = s.mod;
     // Split and Summon on Play are not counted towards the Summon Limit.
     if(skill_id == summon && mod != SkillMod::on_play)
     {
@@ -3081,36 +3257,40 @@ void perform_summon(Field* fd, CardStatus* src_status, const SkillSpec& s)
             _DEBUG_MSG(1, "** Reaching summon limit, this is the last summon.\n");
         }
     }
-    unsigned summoned_id = std::get<1>(s);
-    const Card* summoned = 0;
+    unsigned summoned_id = s.value;
+    const SimCard* summoned = 0;
     if(summoned_id != 0)
     {
-        summoned = fd->cards.by_id(summoned_id);
+        assert(summoned_id < fd->cards.sim_cards_by_id.size() && fd->cards.sim_cards_by_id[summoned_id]);
+        summoned = fd->cards.sim_cards_by_id[summoned_id];
     }
     else
     {
-        Faction summond_faction = std::get<2>(s);
-        do {
-            summoned = fd->random_in_vector(fd->cards.player_assaults);
-        } while(summond_faction != allfactions && summond_faction != summoned->m_faction);
+        summoned = fd->random_in_vector(fd->cards.summon_pools[s.faction]);
     }
     assert(summoned->m_type == CardType::assault || summoned->m_type == CardType::structure);
     Hand* hand{fd->players[player]};
     count_achievement<summon>(fd, src_status);
-    Storage<CardStatus>* storage{summoned->m_type == CardType::assault ? &hand->assaults : &hand->structures};
+    Board* storage{summoned->m_type == CardType::assault ? &hand->assaults : &hand->structures};
+    if(storage->full())
+    {
+        _DEBUG_MSG(1, "%s cannot %s: the board is full\n", status_description(src_status).c_str(), skill_names[skill_id].c_str());
+        return;
+    }
     CardStatus& card_status(storage->add_back());
-    card_status.set(summoned);
+    card_status.set(*summoned);
     card_status.m_index = storage->size() - 1;
     card_status.m_player = player;
+    storage->update(card_status.m_index);
     if(summoned->m_type == CardType::assault && fd->effect == Effect::harsh_conditions)
     {
         ++card_status.m_delay;
     }
     card_status.m_is_summoned = true;
-    _DEBUG_MSG(1, "%s %s %s %u [%s]\n", status_description(src_status).c_str(), skill_names[skill_id].c_str(), cardtype_names[summoned->m_type].c_str(), card_status.m_index, card_description(fd->cards, summoned).c_str());
+    _DEBUG_MSG(1, "%s %s %s %u [%s]\n", status_description(src_status).c_str(), skill_names[skill_id].c_str(), cardtype_names[summoned->m_type].c_str(), card_status.m_index, card_description(fd->cards, summoned->m_info).c_str());
     prepend_skills(fd, &card_status);
     // Summon X (Genesis effect) does not activate Blitz for X
-    if(std::get<1>(s) != 0 && card_status.m_card->m_blitz)
+    if(s.value != 0 && card_status.m_card->m_blitz)
     {
         check_and_perform_blitz(fd, &card_status);
     }
@@ -3140,7 +3320,7 @@ void perform_shock(Field* fd, CardStatus* src_status, const SkillSpec& s)
 
 void perform_overload(Field* fd, CardStatus* src_status, const SkillSpec& s)
 {
-    unsigned skill_value(std::get<1>(s));
+    unsigned skill_value(s.value);
     for(unsigned s_index(1); s_index <= skill_value; ++s_index)
     {
       perform_targetted_hostile_fast<overload>(fd, src_status, s);
@@ -3156,36 +3336,36 @@ void perform_mimic(Field* fd, CardStatus* src_status, const SkillSpec& s)
     // mimic cannot be triggered by anything. So it should be the only skill in the unresolved skill table.
     // so we can probably clear it safely. This is necessary, because mimic calls resolve_skill as well (infinite loop).
     fd->skill_queue.clear();
-    std::vector<CardStatus*>& cards(skill_targets<mimic>(fd, src_status));
+    Board& cards(skill_targets<mimic>(fd, src_status));
     if(select_fast<mimic>(fd, src_status, cards, s, false) == 0)
     {
         return;
     }
     _DEBUG_SELECTION("%s", skill_names[mimic].c_str());
-    CardStatus* c(select_interceptable(fd, src_status, fd->rand(0, fd->selection_array.size() - 1)));
+    CardStatus* c(select_interceptable(fd, src_status, select_random(fd)));
     // evade check for mimic
     // individual skills are subject to evade checks too,
     // but resolve_skill will handle those.
     if(c->m_card->m_evade > 0 && c->m_evades_left > 0 && skill_check<evade>(fd, c, src_status))
     {
         count_achievement<evade>(fd, c);
-        _DEBUG_MSG(1, "%s %s on %s but it evades\n", status_description(src_status).c_str(), skill_names[std::get<0>(s)].c_str(), status_description(c).c_str());
+        _DEBUG_MSG(1, "%s %s on %s but it evades\n", status_description(src_status).c_str(), skill_names[s.id].c_str(), status_description(c).c_str());
         --c->m_evades_left;
         return;
     }
     count_achievement<mimic>(fd, src_status);
-    _DEBUG_MSG(1, "%s %s on %s\n", status_description(src_status).c_str(), skill_names[std::get<0>(s)].c_str(), status_description(c).c_str());
+    _DEBUG_MSG(1, "%s %s on %s\n", status_description(src_status).c_str(), skill_names[s.id].c_str(), status_description(c).c_str());
     auto mod = SkillMod::on_activate;
     bool need_add_skill = may_change_skill(fd, c, mod);
     for(auto& skill: c->m_card->m_skills)
     {
         if(src_status->m_card->m_type != CardType::action && src_status->m_hp == 0)
         { break; }
-        if(std::get<0>(skill) == mimic || std::get<0>(skill) == split ||
-                (std::get<0>(skill) == supply && src_status->m_card->m_type != CardType::assault))
+        if(skill.id == mimic || skill.id == split ||
+                (skill.id == supply && src_status->m_card->m_type != CardType::assault))
         { continue; }
-        auto& battleground_s = need_add_skill ? apply_battleground_effect(fd, c, skill, mod, need_add_skill) : skill;
-        SkillSpec mimic_s(std::get<0>(battleground_s), std::get<1>(battleground_s), allfactions, std::get<3>(battleground_s), mod);
+        auto& battleground_s = need_add_skill ? apply_battleground_effect(fd->effect, c->m_card, skill, mod, need_add_skill) : skill;
+        SkillSpec mimic_s(battleground_s.id, battleground_s.value, allfactions, battleground_s.all, mod);
         _DEBUG_MSG(2, "Evaluating %s mimiced skill %s\n", status_description(c).c_str(), skill_description(fd->cards, mimic_s).c_str());
         fd->skill_queue.emplace_back(src_status, mimic_s);
         resolve_skill(fd);
@@ -3194,9 +3374,9 @@ void perform_mimic(Field* fd, CardStatus* src_status, const SkillSpec& s)
     }
     if(need_add_skill)
     {
-        auto battleground_s = apply_battleground_effect(fd, c, SkillSpec(new_skill, 0, allfactions, false, mod), mod, need_add_skill);
-        assert(std::get<0>(battleground_s) != new_skill);
-        SkillSpec mimic_s(std::get<0>(battleground_s), std::get<1>(battleground_s), allfactions, std::get<3>(battleground_s), mod);
+        auto battleground_s = apply_battleground_effect(fd->effect, c->m_card, SkillSpec(new_skill, 0, allfactions, false, mod), mod, need_add_skill);
+        assert(battleground_s.id != new_skill);
+        SkillSpec mimic_s(battleground_s.id, battleground_s.value, allfactions, battleground_s.all, mod);
         _DEBUG_MSG(2, "Evaluating %s mimiced skill %s\n", status_description(c).c_str(), skill_description(fd->cards, mimic_s).c_str());
         fd->skill_queue.emplace_back(src_status, mimic_s);
         resolve_skill(fd);
@@ -1,17 +1,19 @@
 #ifndef SIM_H_INCLUDED
 #define SIM_H_INCLUDED
 
-#include <boost/pool/pool.hpp>
+#include <cassert>
+#include <cstring>
 #include <string>
 #include <array>
-#include <deque>
 #include <tuple>
+#include <utility>
 #include <vector>
 #include <random>
 
 #include "tyrant.h"
 
 class Card;
+struct SimCard;
 class Cards;
 class Deck;
 class Field;
@@ -22,6 +24,8 @@ extern unsigned debug_cached;
 extern bool debug_line;
 extern std::string debug_str;
 extern unsigned turn_limit;
+// Version of the rules of the battles, part of the keys of the results cache: bump it when a change alters their outcomes.
+const unsigned engine_version{1};
 
 inline unsigned safe_minus(unsigned x, unsigned y)
 {
@@ -37,6 +41,7 @@ struct Results
     result_type losses;
     result_type points;
     result_type sq_points;
+    result_type battles;
     template<typename other_result_type>
     Results& operator+=(const Results<other_result_type>& other)
     {
@@ -45,138 +50,418 @@ struct Results
         losses += other.losses;
         points += other.points;
         sq_points += other.points * other.points;
+        battles += 1;
+        return *this;
+    }
+    // Fold in another accumulator (operator+= folds in a single battle result).
+    template<typename other_result_type>
+    Results& merge(const Results<other_result_type>& other)
+    {
+        wins += other.wins;
+        draws += other.draws;
+        losses += other.losses;
+        points += other.points;
+        sq_points += other.sq_points;
+        battles += other.battles;
         return *this;
     }
 };
 
 void fill_skill_table();
-Results<uint64_t> play(Field* fd);
+typedef Results<uint64_t> (*PlayFunction)(Field* fd);
+// The instance of play() compiled for the battleground effect and the achievement: pick it once, before the battles.
+PlayFunction play_function(const Effect effect, const Achievement& achievement);
 void modify_cards(Cards& cards, enum Effect effect);
-// Pool-based indexed storage.
-//---------------------- Pool-based indexed storage ----------------------------
-template<typename T>
+// Apply a battleground effect to the skills of all the cards, once for all the battles. Returns the program of the effect.
+unsigned compile_skills(Cards& cards, const Effect effect);
+unsigned skill_program_of(const Effect effect);
+//---------------------- Inline indexed storage --------------------------------
+// Cards are stored in place, in order of play, so a scan over the board is a scan over contiguous memory.
+// The capacity is fixed: adding never moves a card, so pointers to them stay valid until the next remove().
+template<typename T, unsigned capacity = 128>
 class Storage
 {
 public:
-    typedef typename std::vector<T*>::size_type size_type;
+    typedef std::size_t size_type;
     typedef T value_type;
-    Storage(size_type size) :
-        m_pool(sizeof(T))
+    typedef T* iterator;
+    typedef const T* const_iterator;
+    Storage() :
+        m_size(0)
     {
-        m_indirect.reserve(size);
     }
 
     inline T& operator[](size_type i)
     {
-        return(*m_indirect[i]);
+        return(m_slots[i]);
     }
 
     inline T& add_back()
     {
-        m_indirect.emplace_back((T*) m_pool.malloc());
-        return(*m_indirect.back());
+        assert(!full());
+        return(m_slots[m_size++]);
     }
 
+    // Stable: the remaining cards keep their order.
+    // Returns the slot of the first removed card (the former size if none): the cards before it did not move.
     template<typename Pred>
-    void remove(Pred p)
+    size_type remove(Pred p)
     {
         size_type head(0);
-        for(size_type current(0); current < m_indirect.size(); ++current)
+        size_type first(m_size);
+        for(size_type current(0); current < m_size; ++current)
         {
-            if(p((*this)[current]))
-            {
-                m_pool.free(m_indirect[current]);
-            }
-            else
+            if(!p(m_slots[current]))
             {
                 if(current != head)
                 {
-                    m_indirect[head] = m_indirect[current];
+                    m_slots[head] = m_slots[current];
                 }
                 ++head;
             }
+            else if(first == m_size)
+            {
+                first = current;
+            }
         }
-        m_indirect.erase(m_indirect.begin() + head, m_indirect.end());
+        m_size = head;
+        return(first);
     }
 
     void reset()
     {
-        for(auto index: m_indirect)
+        m_size = 0;
+    }
+
+    inline size_type size() const
+    {
+        return(m_size);
+    }
+
+    inline bool full() const
+    {
+        return(m_size == capacity);
+    }
+
+    inline iterator begin() { return(m_slots.data()); }
+    inline iterator end() { return(m_slots.data() + m_size); }
+    inline const_iterator begin() const { return(m_slots.data()); }
+    inline const_iterator end() const { return(m_slots.data() + m_size); }
+
+private:
+    size_type m_size;
+    std::array<T, capacity> m_slots;
+};
+//---------------------- Slot masks --------------------------------------------
+// A set of indices of a Storage, one bit per slot. Selecting the targets of a skill combines masks
+// instead of testing every card, and picking one of them is a select-nth-set-bit.
+class SlotMask
+{
+public:
+    static const unsigned num_slots = 128;
+
+    SlotMask() :
+        m_words{{0, 0}}
+    {
+    }
+
+    // The slots [0, n).
+    static inline SlotMask below(unsigned n)
+    {
+        SlotMask mask;
+        mask.m_words[0] = n >= 64 ? ~0ull : (1ull << n) - 1;
+        mask.m_words[1] = n >= num_slots ? ~0ull : n > 64 ? (1ull << (n - 64)) - 1 : 0;
+        return(mask);
+    }
+
+    inline void set(unsigned i) { m_words[i >> 6] |= 1ull << (i & 63); }
+    inline void reset(unsigned i) { m_words[i >> 6] &= ~(1ull << (i & 63)); }
+    inline void set(unsigned i, bool value) { if(value) { set(i); } else { reset(i); } }
+    inline bool test(unsigned i) const { return((m_words[i >> 6] >> (i & 63)) & 1); }
+    inline void clear() { m_words[0] = m_words[1] = 0; }
+    inline bool none() const { return((m_words[0] | m_words[1]) == 0); }
+    inline unsigned count() const { return(popcount(m_words[0]) + popcount(m_words[1])); }
+
+    // The index of the n-th slot of the set, from 0; n < count().
+    inline unsigned nth(unsigned n) const
+    {
+        unsigned word(0);
+        unsigned count0(popcount(m_words[0]));
+        if(n >= count0)
+        {
+            n -= count0;
+            word = 1;
+        }
+        uint64_t bits(m_words[word]);
+        for(; n > 0; --n)
+        {
+            bits &= bits - 1;
+        }
+        return(word * 64 + __builtin_ctzll(bits));
+    }
+
+    // The first slot of the set after i, or num_slots if none.
+    inline unsigned next(unsigned i) const
+    {
+        unsigned start(i + 1);
+        if(start >= num_slots) { return(num_slots); }
+        unsigned word(start >> 6);
+        uint64_t bits(m_words[word] & (~0ull << (start & 63)));
+        while(bits == 0)
+        {
+            if(++word == 2) { return(num_slots); }
+            bits = m_words[word];
+        }
+        return(word * 64 + __builtin_ctzll(bits));
+    }
+
+    // Removes the first slot of a non-empty set and returns it, to walk through a set by value.
+    inline unsigned pop_first()
+    {
+        unsigned word(m_words[0] == 0);
+        unsigned index(__builtin_ctzll(m_words[word]));
+        m_words[word] &= m_words[word] - 1;
+        return(word * 64 + index);
+    }
+
+    // The last slot of the set before i, or num_slots if none.
+    inline unsigned prev(unsigned i) const
+    {
+        if(i == 0) { return(num_slots); }
+        unsigned word((i - 1) >> 6);
+        uint64_t bits(m_words[word] & (~0ull >> (63 - ((i - 1) & 63))));
+        while(bits == 0)
         {
-            m_pool.free(index);
+            if(word-- == 0) { return(num_slots); }
+            bits = m_words[word];
         }
-        m_indirect.clear();
+        return(word * 64 + 63 - __builtin_clzll(bits));
+    }
+
+    inline SlotMask operator&(const SlotMask& other) const { SlotMask mask(*this); mask &= other; return(mask); }
+    inline SlotMask operator|(const SlotMask& other) const { SlotMask mask(*this); mask |= other; return(mask); }
+    inline SlotMask operator~() const { SlotMask mask; mask.m_words[0] = ~m_words[0]; mask.m_words[1] = ~m_words[1]; return(mask); }
+    inline SlotMask& operator&=(const SlotMask& other) { m_words[0] &= other.m_words[0]; m_words[1] &= other.m_words[1]; return(*this); }
+    inline SlotMask& operator|=(const SlotMask& other) { m_words[0] |= other.m_words[0]; m_words[1] |= other.m_words[1]; return(*this); }
+
+private:
+    // Without -mpopcnt __builtin_popcountll is a library call; the SWAR count stays inline.
+    static inline unsigned popcount(uint64_t bits)
+    {
+        bits -= (bits >> 1) & 0x5555555555555555ull;
+        bits = (bits & 0x3333333333333333ull) + ((bits >> 2) & 0x3333333333333333ull);
+        bits = (bits + (bits >> 4)) & 0x0f0f0f0f0f0f0f0full;
+        return((bits * 0x0101010101010101ull) >> 56);
+    }
+
+    std::array<uint64_t, 2> m_words;
+};
+//---------------------- Ring buffer queue -------------------------------------
+// Double-ended queue in a single buffer. It only allocates to grow past its largest size so far,
+// so a queue that is cleared and refilled battle after battle stops allocating once warmed up.
+template<typename T>
+class RingQueue
+{
+public:
+    typedef std::size_t size_type;
+    typedef T value_type;
+    // capacity: a power of two
+    RingQueue(size_type capacity) :
+        m_slots(capacity),
+        m_head(0),
+        m_size(0)
+    {
+        assert((capacity & (capacity - 1)) == 0);
+    }
+
+    inline bool empty() const
+    {
+        return(m_size == 0);
     }
 
     inline size_type size() const
     {
-        return(m_indirect.size());
+        return(m_size);
+    }
+
+    inline T& front()
+    {
+        return(m_slots[m_head]);
+    }
+
+    inline void pop_front()
+    {
+        m_head = (m_head + 1) & (m_slots.size() - 1);
+        -- m_size;
+    }
+
+    template<typename... Args>
+    inline void emplace_back(Args&&... args)
+    {
+        if(m_size == m_slots.size()) { grow(); }
+        m_slots[(m_head + m_size) & (m_slots.size() - 1)] = T(std::forward<Args>(args)...);
+        ++ m_size;
+    }
+
+    template<typename... Args>
+    inline void emplace_front(Args&&... args)
+    {
+        if(m_size == m_slots.size()) { grow(); }
+        m_head = (m_head - 1) & (m_slots.size() - 1);
+        m_slots[m_head] = T(std::forward<Args>(args)...);
+        ++ m_size;
+    }
+
+    void clear()
+    {
+        m_head = 0;
+        m_size = 0;
+    }
+
+private:
+    void grow()
+    {
+        std::vector<T> slots(m_slots.size() * 2);
+        for(size_type i(0); i < m_size; ++i)
+        {
+            slots[i] = m_slots[(m_head + i) & (m_slots.size() - 1)];
+        }
+        m_slots.swap(slots);
+        m_head = 0;
     }
 
-    std::vector<T*> m_indirect;
-    boost::pool<> m_pool;
+    std::vector<T> m_slots;
+    size_type m_head;
+    size_type m_size;
 };
 //------------------------------------------------------------------------------
-enum class CardStep
+enum class CardStep : uint8_t
 {
     none,
     attacking,
     attacked,
 };
 //------------------------------------------------------------------------------
+// Packed in a little over one cache line: amounts stacked from skill values are 16 bits,
+// counters are 8 bits and the flags are bit-fields.
 struct CardStatus
 {
-    const Card* m_card;
-    unsigned m_index;
-    unsigned m_player;
-    unsigned m_augmented;
-    unsigned m_berserk;
-    bool m_blitzing;
-    bool m_chaosed;
-    unsigned m_corroded;
-    unsigned m_corrosion_speed;
-    unsigned m_delay;
-    bool m_diseased;
-    unsigned m_enfeebled;
-    unsigned m_enhance_armored;
-    unsigned m_enhance_berserk;
-    unsigned m_enhance_corrosive;
-    unsigned m_enhance_counter;
-    unsigned m_enhance_enfeeble;
-    unsigned m_enhance_evade;
-    unsigned m_enhance_heal;
-    unsigned m_enhance_leech;
-    unsigned m_enhance_poison;
-    unsigned m_enhance_rally;
-    unsigned m_enhance_strike;
-    unsigned m_evades_left;
-    Faction m_faction;
-    unsigned m_flurry_charge;
-    bool m_frozen;
-    bool m_has_jammed;
+    const SimCard* m_card;
     unsigned m_hp;
-    bool m_immobilized;
-    bool m_infused;
-    unsigned m_inhibited;
-    bool m_jammed;
-    unsigned m_jam_charge;
-    bool m_phased;
-    unsigned m_poisoned;
-    unsigned m_protected;
-    unsigned m_rallied;
-    unsigned m_stunned;
-    bool m_sundered;
-    unsigned m_weakened;
-    bool m_temporary_split;
-    bool m_is_summoned; // is this card summoned (or split)?
+    uint16_t m_augmented;
+    uint16_t m_berserk;
+    uint16_t m_corroded;
+    uint16_t m_corrosion_speed;
+    uint16_t m_inhibited;
+    uint16_t m_poisoned;
+    uint16_t m_rallied;
+    uint16_t m_weakened;
+    // Cleared together at the start of the owner's turn, see reset_turn_modifiers().
+    uint16_t m_enfeebled;
+    uint16_t m_protected;
+    uint16_t m_enhance_armored;
+    uint16_t m_enhance_berserk;
+    uint16_t m_enhance_corrosive;
+    uint16_t m_enhance_counter;
+    uint16_t m_enhance_enfeeble;
+    uint16_t m_enhance_evade;
+    uint16_t m_enhance_heal;
+    uint16_t m_enhance_leech;
+    uint16_t m_enhance_poison;
+    uint16_t m_enhance_rally;
+    uint16_t m_enhance_strike;
+    uint8_t m_index;
+    uint8_t m_player;
+    uint8_t m_delay;
+    uint8_t m_evades_left;
+    uint8_t m_flurry_charge;
+    uint8_t m_jam_charge;
+    uint8_t m_stunned;
+    Faction m_faction : 8;
     CardStep m_step;
+    bool m_blitzing : 1;
+    bool m_chaosed : 1;
+    bool m_diseased : 1;
+    bool m_frozen : 1;
+    bool m_has_jammed : 1;
+    bool m_immobilized : 1;
+    bool m_infused : 1;
+    bool m_jammed : 1;
+    bool m_phased : 1;
+    bool m_sundered : 1;
+    bool m_temporary_split : 1;
+    bool m_is_summoned : 1; // is this card summoned (or split)?
 
     CardStatus() {}
     CardStatus(const Card* card);
 
     void set(const Card* card);
-    void set(const Card& card);
+    void set(const SimCard& card);
     std::string description();
+
+    // Enfeeble, protect and enhancements only last until the start of the owner's next turn.
+    inline void reset_turn_modifiers()
+    {
+        std::memset(&m_enfeebled, 0, reinterpret_cast<char*>(&m_enhance_strike + 1) - reinterpret_cast<char*>(&m_enfeebled));
+    }
+};
+//------------------------------------------------------------------------------
+// One side of the board: the cards in a Storage, with the masks of their slots by the properties that
+// the skills select their targets by. Field::update_masks() keeps the bits of a card in step with it.
+class Board : public Storage<CardStatus, SlotMask::num_slots>
+{
+public:
+    SlotMask alive; // m_hp > 0
+    SlotMask phased;
+    SlotMask walls;
+    std::array<SlotMask, num_factions> factions;
+
+    inline SlotMask occupied() const
+    {
+        return(SlotMask::below(size()));
+    }
+
+    // Sets the bits of the slot index after its card changed.
+    inline void update(size_type index);
+
+    // The cards before the first removed one keep their slots and their bits;
+    // the next ones get their new index.
+    template<typename Pred>
+    size_type remove(Pred p)
+    {
+        size_type old_size(size());
+        size_type first(Storage::remove(p));
+        if(first == old_size) { return(first); }
+        SlotMask kept(SlotMask::below(first));
+        alive &= kept;
+        phased &= kept;
+        walls &= kept;
+        for(auto& mask: factions) { mask &= kept; }
+        for(size_type index(first); index < size(); ++index)
+        {
+            begin()[index].m_index = index;
+            update(index);
+        }
+        return(first);
+    }
+
+    void reset()
+    {
+        Storage::reset();
+        clear_masks();
+    }
+
+    // For the asserts: whether the masks and the indices agree with the cards.
+    bool masks_match() const;
+
+private:
+    void clear_masks()
+    {
+        alive.clear();
+        phased.clear();
+        walls.clear();
+        for(auto& mask: factions) { mask.clear(); }
+    }
 };
 //------------------------------------------------------------------------------
 // Represents a particular draw from a deck.
@@ -186,21 +471,19 @@ class Hand
 public:
 
     Hand(Deck* deck_) :
-        deck(deck_),
-        assaults(15),
-        structures(15)
+        deck(deck_)
     {
     }
 
-    void reset(std::mt19937& re);
+    void reset(RandomEngine& re);
 
     Deck* deck;
     CardStatus commander;
     CardStatus fortress1;
     CardStatus fortress2;
 
-    Storage<CardStatus> assaults;
-    Storage<CardStatus> structures;
+    Board assaults;
+    Board structures;
     unsigned available_summons;
 };
 //------------------------------------------------------------------------------
@@ -210,7 +493,7 @@ class Field
 {
 public:
     bool end;
-    std::mt19937& re;
+    RandomEngine& re;
     const Cards& cards;
     // players[0]: the attacker, players[1]: the defender
     std::array<Hand*, 2> players;
@@ -218,17 +501,21 @@ public:
     unsigned tipi; // and inactive
     Hand* tap;
     Hand* tip;
-    std::vector<CardStatus*> selection_array;
+    // The targets of the skill being performed, in selection_board; see select().
+    Board* selection_board;
+    SlotMask selection;
     unsigned turn;
     gamemode_t gamemode;
     OptimizationMode optimization_mode;
-    const Effect effect;
+    Effect effect;
+    unsigned skill_program; // of effect, see compile_skills()
     const Achievement& achievement;
     // With the introduction of on death skills, a single skill can trigger arbitrary many skills.
     // They are stored in this, and cleared after all have been performed.
-    std::deque<std::tuple<CardStatus*, SkillSpec>> skill_queue;
+    RingQueue<std::tuple<CardStatus*, SkillSpec>> skill_queue;
     std::vector<CardStatus*> killed_with_on_death;
     std::vector<CardStatus*> killed_with_regen;
+    std::vector<std::tuple<CardStatus*, SkillSpec>> on_death_skills; // scratch buffer of prepend_on_death()
     enum phase
     {
         playcard_phase,
@@ -249,22 +536,44 @@ public:
     unsigned fusion_count;
     std::vector<unsigned> achievement_counter;
 
-    Field(std::mt19937& re_, const Cards& cards_, Hand& hand1, Hand& hand2, gamemode_t gamemode_, OptimizationMode optimization_mode_, Effect effect_, const Achievement& achievement_) :
+    // A Field is meant to be kept for many battles: call reset before each of them.
+    // The buffers are sized for a full board (see Storage) and are only cleared between battles.
+    Field(RandomEngine& re_, const Cards& cards_, gamemode_t gamemode_, OptimizationMode optimization_mode_, const Achievement& achievement_) :
         end{false},
         re(re_),
         cards(cards_),
-        players{{&hand1, &hand2}},
+        players{{nullptr, nullptr}},
+        selection_board(nullptr),
         turn(1),
         gamemode(gamemode_),
         optimization_mode(optimization_mode_),
-        effect(effect_),
-        achievement(achievement_)
+        effect(Effect::none),
+        skill_program(0),
+        achievement(achievement_),
+        skill_queue(256)
+    {
+        killed_with_on_death.reserve(512);
+        killed_with_regen.reserve(512);
+        on_death_skills.reserve(256);
+    }
+
+    void reset(Hand& hand1, Hand& hand2, Effect effect_)
     {
+        end = false;
+        players = {{&hand1, &hand2}};
+        turn = 1;
+        effect = effect_;
+        skill_program = skill_program_of(effect_);
+        selection_board = nullptr;
+        selection.clear();
+        skill_queue.clear();
+        killed_with_on_death.clear();
+        killed_with_regen.clear();
     }
 
     inline unsigned rand(unsigned x, unsigned y)
     {
-        return(std::uniform_int_distribution<unsigned>(x, y)(re));
+        return(x + re.bounded(y - x + 1));
     }
 
     inline unsigned flip()
@@ -280,9 +589,14 @@ public:
         return(v[this->rand(0, v.size() - 1)]);
     }
 
-    template <typename CardsIter, typename Functor>
-    inline unsigned make_selection_array(CardsIter first, CardsIter last, Functor f);
-    inline void print_selection_array();
+    // Select the cards of board among candidates for which f holds, and return how many.
+    template <typename Functor>
+    inline unsigned select(Board& board, SlotMask candidates, Functor f);
+    inline unsigned select(Board& board, SlotMask candidates);
+    inline CardStatus* selected(unsigned index) { return(&(*selection_board)[index]); }
+    inline void print_selection();
+    // Update the bits of a card in the masks of its board, after a change of its hp, faction or phase.
+    inline void update_masks(const CardStatus* status);
 
     template <class T>
     inline void set_counter(T& container, unsigned key, unsigned value)
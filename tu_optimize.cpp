@@ -13,31 +13,49 @@
 //------------------------------------------------------------------------------
 #define BOOST_THREAD_USE_LIB
 #include <cassert>
+#include <cctype>
+#include <cmath>
+#include <chrono>
+#include <cstdlib>
 #include <cstring>
 #include <ctime>
 #include <iostream>
 #include <vector>
 #include <string>
 #include <map>
+#include <memory>
+#include <new>
 #include <set>
 #include <tuple>
+#include <unordered_map>
+#include <atomic>
 #include <boost/range/join.hpp>
 #include <boost/optional.hpp>
 #include <boost/thread/thread.hpp>
 #include <boost/thread/mutex.hpp>
 #include <boost/thread/barrier.hpp>
 #include <boost/math/distributions/binomial.hpp>
+#include <boost/math/distributions/normal.hpp>
 #include "card.h"
 #include "cards.h"
 #include "deck.h"
 #include "achievement.h"
 #include "read.h"
+#include "results_cache.h"
 #include "sim.h"
 #include "tyrant.h"
 #include "xml.h"
 #include "custom_card.h"
 //#include "timer.hpp"
 
+// How compare mode decides to stop evaluating a deck early.
+enum class StopRule
+{
+    binomial, // loose upper bound of the score, only rejects
+    sprt, // sequential probability ratio test
+    bayes // posterior probability of beating the best deck
+};
+
 namespace {
     gamemode_t gamemode{fight};
     OptimizationMode optimization_mode{OptimizationMode::winrate};
@@ -49,8 +67,23 @@ namespace {
     unsigned fund{0};
     bool auto_upgrade_cards{true};
     long double target_score{100};
+    long double climb_ci{0}; // climb ci=<num>: target half-width of the confidence interval of the best score
     bool show_stdev{false};
     bool use_harmonic_mean{false};
+    uint64_t sim_seed{0};
+    bool use_crn{false};
+    bool use_racing{false};
+    bool use_stratified{false};
+    StopRule stop_rule{StopRule::sprt};
+    long double stop_alpha{0.01}; // chance to reject a better deck
+    long double stop_beta{0.01}; // chance to accept a worse deck
+    long double stop_z_alpha{0}; // standard normal quantiles of 1 - stop_alpha and 1 - stop_beta, once the arguments are read
+    long double stop_z_beta{0};
+    unsigned population_size{32}; // evolve
+    const char* const default_evolve_battles{"1000"}; // evolve <generations> without <num>
+    std::pair<long double, long double> anneal_temperatures{2, 0.05}; // anneal: temperatures of the first and last rounds, in % of the best possible score
+    unsigned anneal_rounds{200};
+    unsigned climb_starts{1}; // climb -starts <num>
 }
 
 using namespace std::placeholders;
@@ -200,19 +233,26 @@ unsigned get_deck_cost(const Deck * deck, const Cards & cards)
 }
 
 //------------------------------------------------------------------------------
-Results<long double> compute_score(const std::pair<std::vector<Results<uint64_t>> , unsigned>& results, std::vector<long double>& factors)
+// +strat: a defense deck may have played fewer than total battles; scales its sums up to total battles.
+inline long double battle_scale(const Results<uint64_t>& result, unsigned total)
+{
+    return(result.battles == 0 || result.battles == total ? 1.0 : (long double)total / result.battles);
+}
+//------------------------------------------------------------------------------
+Results<long double> compute_score(const std::pair<std::vector<Results<uint64_t>> , unsigned>& results, const std::vector<long double>& factors)
 {
     Results<long double> final{0, 0, 0, 0, 0};
     for(unsigned index(0); index < results.first.size(); ++index)
     {
-        final.wins += results.first[index].wins * factors[index];
-        final.draws += results.first[index].draws * factors[index];
-        final.losses += results.first[index].losses * factors[index];
+        long double scale = battle_scale(results.first[index], results.second);
+        final.wins += results.first[index].wins * scale * factors[index];
+        final.draws += results.first[index].draws * scale * factors[index];
+        final.losses += results.first[index].losses * scale * factors[index];
         if(use_harmonic_mean)
-        { final.points += factors[index] / results.first[index].points; }
+        { final.points += factors[index] / (results.first[index].points * scale); }
         else
-        { final.points += results.first[index].points * factors[index]; }
-        final.sq_points += results.first[index].sq_points * factors[index] * factors[index];
+        { final.points += results.first[index].points * scale * factors[index]; }
+        final.sq_points += results.first[index].sq_points * scale * factors[index] * factors[index];
     }
     long double factor_sum = std::accumulate(factors.begin(), factors.end(), 0.);
     final.wins /= factor_sum * (long double)results.second;
@@ -226,42 +266,264 @@ Results<long double> compute_score(const std::pair<std::vector<Results<uint64_t>
     return final;
 }
 //------------------------------------------------------------------------------
-volatile unsigned thread_num_iterations{0}; // written by threads
-std::vector<Results<uint64_t>> thread_results; // written by threads
-volatile unsigned thread_total{0}; // written by threads
-volatile long double thread_prev_score{0.0};
+long double best_possible_points()
+{
+    return(optimization_mode == OptimizationMode::raid ? 250 : optimization_mode == OptimizationMode::gw_abp ? 79 : 100);
+}
+//------------------------------------------------------------------------------
+// A deck that never lost so far may still lose: the variance of the points is taken
+// to be at least the one of a single loss in num_battles + 1 battles.
+long double min_points_variance(long double num_battles)
+{
+    return(best_possible_points() * best_possible_points() * num_battles / ((num_battles + 1) * (num_battles + 1)));
+}
+//------------------------------------------------------------------------------
+// Number of battles for the 95% confidence interval of the score to be within +/- half_width,
+// from the variance of the points seen so far.
+unsigned battles_for_ci(const std::pair<std::vector<Results<uint64_t>> , unsigned>& results, const std::vector<long double>& factors, long double half_width)
+{
+    long double factor_sum = std::accumulate(factors.begin(), factors.end(), 0.);
+    long double total = results.second;
+    long double variance = 0.0;
+    for(unsigned index(0); index < results.first.size(); ++index)
+    {
+        // +strat: a deck playing a fraction of the battles counts for as much more variance.
+        long double scale = battle_scale(results.first[index], results.second);
+        long double mean = results.first[index].points * scale / total;
+        long double weight = factors[index] / factor_sum;
+        variance += weight * weight * scale * (results.first[index].sq_points * scale / total - mean * mean);
+    }
+    variance = std::max(variance, min_points_variance(total));
+    return(std::min<long double>(UINT_MAX, ceil(1.96 * 1.96 * variance / (half_width * half_width))));
+}
+//------------------------------------------------------------------------------
+// Battles are handed out by blocks; compare mode checks whether to stop once per block,
+// in battle order, so that the decision doesn't depend on the number of threads nor on their timing.
+const unsigned battle_block_size{16};
+// Battles of the first round of an evaluation driven by a confidence interval (sim ci=...).
+const unsigned ci_min_battles{256};
+// Battles of the first round of a race (+race).
+const unsigned race_min_battles{battle_block_size};
+// Battles against every defense deck to estimate their variance (+strat).
+const unsigned strat_pilot_battles{16 * battle_block_size};
+//------------------------------------------------------------------------------
+// Compare mode: block of battles of a candidate deck played out of order,
+// waiting for the blocks before it.
+struct PendingBlock
+{
+    std::vector<Results<uint64_t>> results;
+    unsigned num_battles;
+};
+//------------------------------------------------------------------------------
+// Progress of one candidate deck.
+// results and total only cover the blocks committed in order.
+// The candidates are resolved (stopped early or fully evaluated) in order too:
+// the blocks of a candidate are only committed once the candidates before it are resolved,
+// so that it can be stopped as soon as it can't beat any of them.
+struct CompareProgress
+{
+    std::vector<Results<uint64_t>> results;
+    unsigned total;
+    std::map<unsigned, PendingBlock> pending_blocks;
+    unsigned num_committed_blocks;
+    std::vector<float> battle_scores; // crn mode only: score of each battle
+    long double diff_sum; // crn mode only: committed paired differences
+    long double diff_sq_sum; // crn mode only
+    volatile bool stop;
+    bool accepted; // stopped early because it is better
+
+    void reset(unsigned num_battles, unsigned num_def_decks)
+    {
+        results.assign(num_def_decks, Results<uint64_t>{0, 0, 0, 0, 0});
+        total = 0;
+        pending_blocks.clear();
+        num_committed_blocks = 0;
+        battle_scores.assign(use_crn ? num_battles : 0, 0);
+        diff_sum = 0;
+        diff_sq_sum = 0;
+        stop = false;
+        accepted = false;
+    }
+};
+//------------------------------------------------------------------------------
+#ifndef NDEBUG
+// Debug builds count the heap allocations of each thread: battles must not allocate once warmed up.
+// The whole family is replaced (no sized forms in C++11). The operators aren't inlined: g++ would then see
+// free() called on the result of operator new and fail the build with -Werror=mismatched-new-delete.
+thread_local unsigned long thread_num_allocations{0};
+
+__attribute__((noinline)) void* count_allocation(std::size_t size) noexcept
+{
+    ++ thread_num_allocations;
+    return(std::malloc(size ? size : 1));
+}
+
+__attribute__((noinline)) void free_allocation(void* p) noexcept
+{
+    std::free(p);
+}
+
+void* operator new(std::size_t size)
+{
+    if(void* p = count_allocation(size)) { return(p); }
+    throw std::bad_alloc();
+}
+
+void* operator new[](std::size_t size)
+{
+    if(void* p = count_allocation(size)) { return(p); }
+    throw std::bad_alloc();
+}
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept { return(count_allocation(size)); }
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept { return(count_allocation(size)); }
+void operator delete(void* p) noexcept { free_allocation(p); }
+void operator delete[](void* p) noexcept { free_allocation(p); }
+void operator delete(void* p, const std::nothrow_t&) noexcept { free_allocation(p); }
+void operator delete[](void* p, const std::nothrow_t&) noexcept { free_allocation(p); }
+#endif
+//------------------------------------------------------------------------------
+unsigned thread_num_battles{0}; // per candidate deck
+unsigned thread_num_blocks{0}; // per candidate deck
+std::vector<unsigned> thread_first_battles; // per candidate deck: battle numbers start there, past the battles of the earlier rounds of a race and of the results cache
+std::vector<long double> thread_def_ratios; // +strat: share of the battles played against each defense deck, empty otherwise
+std::vector<uint64_t> thread_eval_seeds; // per candidate deck
+std::vector<CompareProgress> thread_progress; // per candidate deck, written by threads
+std::vector<unsigned> thread_segment_starts; // per thread, see slot_block()
+unsigned thread_num_resolved{0}; // written by threads, compare mode only: candidates resolved
+std::vector<float> thread_reference_scores; // crn mode only: scores of the incumbent deck
+const std::vector<float>* thread_reference{nullptr}; // written by threads, crn mode only: scores of the deck to beat
+long double thread_paired_margin{0}; // written by threads, crn mode only: see Process::paired_margin
+volatile long double thread_prev_score{0.0}; // written by threads
 volatile bool thread_compare{false};
-volatile bool thread_compare_stop{false}; // written by threads
+bool thread_stop_early{true}; // compare mode: false to play all the battles of every candidate
 volatile bool destroy_threads;
+unsigned thread_max_chunk{1};
+//------------------------------------------------------------------------------
+// +strat: whether a defense deck given ratio of the battles plays battle number battle.
+// Its battles are spread evenly: it has played floor(n * ratio) of the first n battles.
+inline bool def_deck_plays(long double ratio, uint64_t battle)
+{
+    return(floor((battle + 1) * ratio) > floor(battle * ratio));
+}
+//------------------------------------------------------------------------------
+// Maps consecutive counters to unrelated seeds.
+inline uint64_t mix_seed(uint64_t x)
+{
+    return(SplitMix64(x)());
+}
+//------------------------------------------------------------------------------
+// Maps a slot of the thread ranges to a block of battles of all the candidate decks.
+// The slots of thread i are the blocks i, i + num_threads, i + 2 * num_threads...
+// so that the threads go through the candidate decks together, each one in battle order.
+inline unsigned slot_block(unsigned slot)
+{
+    unsigned segment(thread_segment_starts.size() - 1);
+    while(slot < thread_segment_starts[segment]) { -- segment; }
+    return((slot - thread_segment_starts[segment]) * thread_segment_starts.size() + segment);
+}
+//------------------------------------------------------------------------------
+// Slots [begin, end) waiting to be played by one thread (see slot_block()).
+// Both bounds are packed in a single atomic word: the owner claims from the front,
+// idle threads steal from the back, and neither has to lock.
+class BattleRange
+{
+public:
+    void assign(unsigned begin, unsigned end)
+    {
+        m_bounds.store(pack(begin, end));
+    }
+
+    unsigned remaining() const
+    {
+        uint64_t bounds(m_bounds.load());
+        return(end_of(bounds) - begin_of(bounds));
+    }
+
+    // Owner side: claims up to max_chunk slots, fewer as the range runs out,
+    // so that the last battles are spread over the threads.
+    unsigned claim(unsigned max_chunk, unsigned& first)
+    {
+        uint64_t bounds(m_bounds.load());
+        while(true)
+        {
+            unsigned begin(begin_of(bounds)), end(end_of(bounds));
+            if(begin >= end) { return(0); }
+            unsigned num_claimed(std::max(1u, std::min(max_chunk, (end - begin) / 4)));
+            if(m_bounds.compare_exchange_weak(bounds, pack(begin + num_claimed, end)))
+            {
+                first = begin;
+                return(num_claimed);
+            }
+        }
+    }
+
+    // Thief side: takes the back half (rounded up) of the range.
+    unsigned steal(unsigned& first)
+    {
+        uint64_t bounds(m_bounds.load());
+        while(true)
+        {
+            unsigned begin(begin_of(bounds)), end(end_of(bounds));
+            if(begin >= end) { return(0); }
+            unsigned num_stolen((end - begin + 1) / 2);
+            if(m_bounds.compare_exchange_weak(bounds, pack(begin, end - num_stolen)))
+            {
+                first = end - num_stolen;
+                return(num_stolen);
+            }
+        }
+    }
+
+private:
+    static uint64_t pack(unsigned begin, unsigned end) { return((uint64_t)begin << 32 | end); }
+    static unsigned begin_of(uint64_t bounds) { return(bounds >> 32); }
+    static unsigned end_of(uint64_t bounds) { return(bounds & 0xffffffff); }
+    std::atomic<uint64_t> m_bounds{0};
+};
 //------------------------------------------------------------------------------
 // Per thread data.
-// seed should be unique for each thread.
-// d1 and d2 are intended to point to read-only process-wide data.
+// re is reseeded for every battle, from the battle index: separately for the attacker's draw,
+// the defender's draw and the battle itself, so that changing a card of the attack deck
+// leaves the other random streams untouched.
+// att_decks and def_decks are copies of the decks being evaluated.
+// results and total accumulate the battles played by this thread only (evaluate mode);
+// Process merges them once all the threads are done.
 struct SimulationData
 {
-    std::mt19937 re;
+    RandomEngine re;
     const Cards& cards;
     const Decks& decks;
-    std::shared_ptr<Deck> att_deck;
-    Hand att_hand;
+    std::vector<std::shared_ptr<Deck>> att_decks;
+    std::vector<Hand*> att_hands;
     std::vector<std::shared_ptr<Deck>> def_decks;
     std::vector<Hand*> def_hands;
+    std::vector<PlayFunction> def_plays; // play() as compiled for the effect against each defense deck
     std::vector<long double> factors;
+    long double factor_sum;
     gamemode_t gamemode;
     enum Effect effect;
     const Achievement& achievement;
+    std::vector<Results<uint64_t>> results;
+    unsigned total;
+    Field field; // reset for every battle
+#ifndef NDEBUG
+    unsigned num_battles_played{0};
+#endif
 
-    SimulationData(unsigned seed, const Cards& cards_, const Decks& decks_, unsigned num_def_decks_, std::vector<long double> factors_, gamemode_t gamemode_, enum Effect effect_, const Achievement& achievement_) :
-        re(seed),
+    SimulationData(const Cards& cards_, const Decks& decks_, unsigned num_def_decks_, std::vector<long double> factors_, gamemode_t gamemode_, enum Effect effect_, const Achievement& achievement_) :
         cards(cards_),
         decks(decks_),
-        att_deck(),
-        att_hand(nullptr),
         def_decks(num_def_decks_),
+        def_plays(num_def_decks_),
         factors(factors_),
+        factor_sum(std::accumulate(factors.begin(), factors.end(), .0)),
         gamemode(gamemode_),
         effect(effect_),
-        achievement(achievement_)
+        achievement(achievement_),
+        results(num_def_decks_),
+        total(0),
+        field(re, cards_, gamemode_, optimization_mode, achievement_)
     {
         for(auto def_deck: def_decks)
         {
@@ -271,32 +533,67 @@ struct SimulationData
 
     ~SimulationData()
     {
+        for(auto hand: att_hands) { delete(hand); }
         for(auto hand: def_hands) { delete(hand); }
     }
 
-    void set_decks(const Deck* const att_deck_, std::vector<Deck*> const & def_decks_)
+    void set_decks(std::vector<const Deck*> const & att_decks_, std::vector<Deck*> const & def_decks_)
     {
-        att_deck.reset(att_deck_->clone());
-        att_hand.deck = att_deck.get();
+        att_decks.resize(att_decks_.size());
+        while(att_hands.size() < att_decks_.size())
+        {
+            att_hands.emplace_back(new Hand(nullptr));
+        }
+        for(unsigned i(0); i < att_decks_.size(); ++i)
+        {
+            att_decks[i].reset(att_decks_[i]->clone());
+            att_hands[i]->deck = att_decks[i].get();
+        }
         for(unsigned i(0); i < def_decks_.size(); ++i)
         {
             def_decks[i].reset(def_decks_[i]->clone());
             def_hands[i]->deck = def_decks[i].get();
+            def_plays[i] = play_function(effect != Effect::none ? effect : def_decks[i]->effect, achievement);
         }
     }
 
-    inline std::vector<Results<uint64_t>> evaluate()
+    void reset_results()
     {
-        std::vector<Results<uint64_t>> res;
-        for(Hand* def_hand: def_hands)
-        {
+        std::fill(results.begin(), results.end(), Results<uint64_t>{0, 0, 0, 0, 0});
+        total = 0;
+    }
+
+    // Play battle number battle of the candidate deck against each defense deck and add the outcomes to res.
+    // The draws only depend on thread_eval_seeds[candidate] and battle, whichever thread plays it.
+    // Returns the points of the battle, weighted by the factors.
+    inline long double evaluate(std::vector<Results<uint64_t>>& res, unsigned candidate, unsigned battle)
+    {
+        long double score(0);
+        Hand& att_hand(*att_hands[candidate]);
+        for(unsigned index(0); index < def_hands.size(); ++index)
+        {
+            if(!thread_def_ratios.empty() && !def_deck_plays(thread_def_ratios[index], thread_first_battles[candidate] + battle)) { continue; }
+            uint64_t battle_seed(mix_seed(thread_eval_seeds[candidate] + ((uint64_t)thread_first_battles[candidate] + battle) * def_hands.size() + index));
+            Hand* def_hand(def_hands[index]);
+            re.seed(mix_seed(battle_seed));
             att_hand.reset(re);
+            re.seed(mix_seed(battle_seed + 1));
             def_hand->reset(re);
-            Field fd(re, cards, att_hand, *def_hand, gamemode, optimization_mode, effect != Effect::none ? effect : def_hand->deck->effect, achievement);
-            Results<uint64_t> result(play(&fd));
-            res.emplace_back(result);
+            re.seed(mix_seed(battle_seed + 2));
+            field.reset(att_hand, *def_hand, effect != Effect::none ? effect : def_hand->deck->effect);
+#ifndef NDEBUG
+            unsigned long num_allocations(thread_num_allocations);
+#endif
+            auto result(def_plays[index](&field));
+#ifndef NDEBUG
+            // Once a thread has played its first battle, its buffers are large enough for the next ones.
+            assert(num_battles_played == 0 || debug_print > 0 || thread_num_allocations == num_allocations);
+            ++ num_battles_played;
+#endif
+            score += result.points * factors[index];
+            res[index] += result;
         }
-        return(res);
+        return(score / factor_sum);
     }
 };
 //------------------------------------------------------------------------------
@@ -304,7 +601,7 @@ class Process;
 void thread_evaluate(boost::barrier& main_barrier,
                      boost::mutex& shared_mutex,
                      SimulationData& sim,
-                     const Process& p,
+                     Process& p,
                      unsigned thread_id);
 //------------------------------------------------------------------------------
 class Process
@@ -313,19 +610,27 @@ public:
     unsigned num_threads;
     std::vector<boost::thread*> threads;
     std::vector<SimulationData*> threads_data;
+    std::vector<BattleRange> battle_ranges; // one per thread
+    unsigned num_evaluations;
     boost::barrier main_barrier;
     boost::mutex shared_mutex;
     const Cards& cards;
     const Decks& decks;
     Deck* att_deck;
+    std::vector<const Deck*> att_decks; // the decks being evaluated: att_deck or the candidates of compare_many()
     const std::vector<Deck*> def_decks;
     std::vector<long double> factors;
     gamemode_t gamemode;
     enum Effect effect;
     Achievement achievement;
+    ResultsCache* results_cache{nullptr}; // -cache: the battles of the former runs, nullptr otherwise
+    bool keep_results{false}; // without results cache: keep the battles of the decks evaluated during the run instead
+    long double paired_margin{0}; // crn mode: what the candidates of compare_many() have to beat the reference deck by
 
     Process(unsigned _num_threads, const Cards& cards_, const Decks& decks_, Deck* att_deck_, std::vector<Deck*> _def_decks, std::vector<long double> _factors, gamemode_t _gamemode, enum Effect _effect, const Achievement& achievement_) :
         num_threads(_num_threads),
+        battle_ranges(num_threads),
+        num_evaluations(0),
         main_barrier(num_threads+1),
         cards(cards_),
         decks(decks_),
@@ -337,10 +642,10 @@ public:
         achievement(achievement_)
     {
         destroy_threads = false;
-        unsigned seed(time(0));
+        thread_segment_starts.resize(num_threads);
         for(unsigned i(0); i < num_threads; ++i)
         {
-            threads_data.push_back(new SimulationData(seed + i, cards, decks, def_decks.size(), factors, gamemode, effect, achievement));
+            threads_data.push_back(new SimulationData(cards, decks, def_decks.size(), factors, gamemode, effect, achievement));
             threads.push_back(new boost::thread(thread_evaluate, std::ref(main_barrier), std::ref(shared_mutex), std::ref(*threads_data.back()), std::ref(*this), i));
         }
     }
@@ -355,96 +660,578 @@ public:
 
     std::pair<std::vector<Results<uint64_t>> , unsigned> evaluate(unsigned num_iterations)
     {
-        thread_num_iterations = num_iterations;
-        thread_results = std::vector<Results<uint64_t>>(def_decks.size());
-        thread_total = 0;
+        return(evaluate(num_iterations, att_deck));
+    }
+
+    // Plays num_iterations new battles with the deck, past first_battle ones not in the results cache (see thread_first_battles).
+    std::pair<std::vector<Results<uint64_t>> , unsigned> evaluate(unsigned num_iterations, const Deck* deck, unsigned first_battle = 0)
+    {
+        att_decks = {deck};
+        distribute(num_iterations, first_battle);
         thread_compare = false;
         // unlock all the threads
         main_barrier.wait();
         // wait for the threads
         main_barrier.wait();
-        return(std::make_pair(thread_results, thread_total));
+        keep_battle_scores(true);
+        auto results(merge_results());
+        store_results(deck, results);
+        return(results);
+    }
+
+    // The battles of the deck kept by the results cache, topped up with new ones up to num_iterations.
+    std::pair<std::vector<Results<uint64_t>> , unsigned> evaluate_cached(unsigned num_iterations, const Deck* deck)
+    {
+        auto results(cached_results(deck));
+        if(results.second == 0) { return(evaluate(num_iterations, deck)); }
+        if(results.second < num_iterations)
+        {
+            auto more(evaluate(num_iterations - results.second, deck));
+            for(unsigned index(0); index < results.first.size(); ++index)
+            {
+                results.first[index].merge(more.first[index]);
+            }
+            results.second += more.second;
+        }
+        // crn mode: the scores of the cached battles aren't kept, the deck needs them to be a reference.
+        if(use_crn) { last_battle_scores.assign(1, replay_scores(num_iterations, deck)); }
+        return(results);
+    }
+
+    // +strat: plays a few battles against every defense deck, then plays each one in a share of the battles
+    // proportional to its factor times the standard deviation of its points (Neyman allocation).
+    // The shares are scaled for the score to be about as precise as when every battle plays all the defense decks.
+    void stratify()
+    {
+        thread_def_ratios.clear();
+        auto results(evaluate(strat_pilot_battles));
+        long double total = results.second;
+        std::vector<long double> spreads;
+        long double spread_sum(0), sq_spread_sum(0);
+        for(unsigned index(0); index < results.first.size(); ++index)
+        {
+            long double mean = results.first[index].points / total;
+            long double variance = std::max(results.first[index].sq_points / total - mean * mean, min_points_variance(total));
+            spreads.push_back(factors[index] * sqrt(variance));
+            spread_sum += spreads.back();
+            sq_spread_sum += spreads.back() * spreads.back();
+        }
+        if(sq_spread_sum <= 0) { return; }
+        long double battles_per_iteration(0);
+        for(auto spread: spreads)
+        {
+            // every defense deck still plays once per block, none more than once per battle.
+            thread_def_ratios.push_back(std::max(1.0L / battle_block_size, std::min<long double>(1, spread * spread_sum / sq_spread_sum)));
+            battles_per_iteration += thread_def_ratios.back();
+        }
+        std::cout << "Battles per iteration: " << battles_per_iteration << " (instead of " << def_decks.size() << ")" << std::endl;
+    }
+
+    // Evaluates the attack deck by rounds of battles until the 95% confidence interval of its score
+    // is within +/- half_width.
+    std::pair<std::vector<Results<uint64_t>> , unsigned> evaluate_ci(long double half_width)
+    {
+        auto results(evaluate_cached(ci_min_battles, att_deck));
+        for(unsigned num_needed; (num_needed = battles_for_ci(results, factors, half_width)) > results.second; )
+        {
+            // past the battles played so far: in crn mode, every deck plays the same battles from the first one.
+            auto more(evaluate(num_needed - results.second, att_deck, results.second - cached_results(att_deck).second));
+            for(unsigned index(0); index < results.first.size(); ++index)
+            {
+                results.first[index].merge(more.first[index]);
+            }
+            results.second += more.second;
+        }
+        return(results);
     }
 
     std::pair<std::vector<Results<uint64_t>> , unsigned> compare(unsigned num_iterations, long double prev_score)
     {
-        thread_num_iterations = num_iterations;
-        thread_results = std::vector<Results<uint64_t>>(def_decks.size());
-        thread_total = 0;
+        std::vector<Deck> candidates{*att_deck};
+        return(compare_many(candidates, num_iterations, prev_score)[0]);
+    }
+
+    // Evaluates all the candidate decks at once, so that the threads don't wait for each other
+    // between the candidates. As if compare() was called on each one in turn with prev_score
+    // raised to the score of every candidate beating it.
+    // The candidates with num_iterations battles in the results cache aren't played again: their score counts first.
+    // The ones with fewer are topped up, in a round of their own per number of cached battles, after the others.
+    // Only the candidates that play all the battles add them to the results cache.
+    // stop_early false: plays all the battles of every candidate, to rank them all.
+    std::vector<std::pair<std::vector<Results<uint64_t>> , unsigned>> compare_many(const std::vector<Deck>& candidates, unsigned num_iterations, long double prev_score, bool stop_early = true)
+    {
+        std::vector<std::pair<std::vector<Results<uint64_t>> , unsigned>> results;
+        std::map<unsigned, std::vector<const Deck*>> played; // by number of cached battles
+        partial_results.clear();
+        for(unsigned i(0); i < candidates.size(); ++i)
+        {
+            results.emplace_back(cached_results(&candidates[i]));
+            if(results.back().second >= num_iterations)
+            {
+                prev_score = std::max(prev_score, compute_score(results.back(), factors).points);
+            }
+            else
+            {
+                played[results.back().second].emplace_back(&candidates[i]);
+            }
+        }
+        // crn mode: the battles of the cached candidates aren't known one by one, nor the ones of the topped up ones.
+        std::vector<std::vector<float>> battle_scores(use_crn ? candidates.size() : 0);
+        for(auto& group: played)
+        {
+            // the new battles are numbered past the cached ones (see distribute()).
+            unsigned num_battles(num_iterations - group.first);
+            // the slots of all the candidates must fit in an unsigned.
+            unsigned max_candidates(std::max<unsigned>(1, UINT_MAX / ((num_battles + battle_block_size - 1) / battle_block_size + 1)));
+            for(unsigned begin(0); begin < group.second.size(); begin += max_candidates)
+            {
+                att_decks.assign(group.second.begin() + begin, group.second.begin() + std::min<unsigned>(group.second.size(), begin + max_candidates));
+                thread_stop_early = stop_early;
+                auto part(run_compare(num_battles, prev_score));
+                thread_stop_early = true;
+                prev_score = thread_prev_score;
+                keep_battle_scores(true);
+                for(unsigned k(0); k < part.size(); ++k)
+                {
+                    auto& result(results[att_decks[k] - candidates.data()]);
+                    // a deck stopped early played a biased sample: only the complete evaluations are kept.
+                    if(part[k].second == num_battles) { store_results(att_decks[k], part[k]); }
+                    else
+                    {
+                        PartialResults& partial(partial_results[att_decks[k] - candidates.data()]);
+                        partial.deck = att_decks[k];
+                        partial.results = part[k];
+                        // crn mode: the committed battles are the first ones.
+                        if(use_crn && group.first == 0)
+                        {
+                            partial.battle_scores.assign(thread_progress[k].battle_scores.begin(), thread_progress[k].battle_scores.begin() + part[k].second);
+                        }
+                    }
+                    for(unsigned index(0); index < result.first.size(); ++index)
+                    {
+                        result.first[index].merge(part[k].first[index]);
+                    }
+                    result.second += part[k].second;
+                    if(use_crn) { battle_scores[att_decks[k] - candidates.data()] = std::move(last_battle_scores[k]); }
+                }
+            }
+        }
+        if(use_crn) { last_battle_scores = std::move(battle_scores); }
+        return(results);
+    }
+
+    // Plays num_iterations battles with each deck, numbered from first_battle, without stopping early.
+    std::vector<std::pair<std::vector<Results<uint64_t>> , unsigned>> evaluate_many(const std::vector<const Deck*>& decks, unsigned num_iterations, unsigned first_battle)
+    {
+        att_decks = decks;
+        thread_stop_early = false;
+        auto results(run_compare(num_iterations, 0, first_battle));
+        thread_stop_early = true;
+        return(results);
+    }
+
+    // A candidate of the last compare_many() that stopped early (results): plays the rest of its battles up to num_iterations,
+    // past the committed ones, and keeps them all in the results cache. In crn mode, the candidate then counts as the last deck
+    // evaluated (see use_last_as_reference()).
+    void complete_partial(unsigned candidate, unsigned num_iterations, std::pair<std::vector<Results<uint64_t>> , unsigned>& results)
+    {
+        PartialResults& partial(partial_results.at(candidate));
+        att_decks = {partial.deck};
+        distribute(num_iterations - results.second, partial.results.second);
+        thread_compare = false;
+        // unlock all the threads
+        main_barrier.wait();
+        // wait for the threads
+        main_barrier.wait();
+        if(use_crn)
+        {
+            std::vector<float>& more_scores(thread_progress[0].battle_scores);
+            if(!partial.battle_scores.empty()) { partial.battle_scores.insert(partial.battle_scores.end(), more_scores.begin(), more_scores.end()); }
+            last_battle_scores.assign(1, std::move(partial.battle_scores));
+        }
+        auto more(merge_results());
+        for(unsigned index(0); index < results.first.size(); ++index)
+        {
+            results.first[index].merge(more.first[index]);
+            partial.results.first[index].merge(more.first[index]);
+        }
+        results.second += more.second;
+        partial.results.second += more.second;
+        store_results(partial.deck, partial.results);
+        partial_results.erase(candidate);
+    }
+
+    // crn mode: the deck of the last evaluate() or compare() (or the candidate of the last compare_many())
+    // becomes the one the next candidates are compared with, battle by battle.
+    void use_last_as_reference(unsigned candidate = 0)
+    {
+        if(use_crn) { thread_reference_scores = last_battle_scores[candidate]; }
+    }
+
+    // crn mode: the deck becomes the reference even if its battles come from the results cache.
+    void use_as_reference(unsigned num_iterations, const Deck* deck)
+    {
+        if(use_crn) { thread_reference_scores = replay_scores(num_iterations, deck); }
+    }
+
+private:
+    struct PartialResults
+    {
+        const Deck* deck;
+        std::pair<std::vector<Results<uint64_t>> , unsigned> results; // the committed battles, past the cached ones
+        std::vector<float> battle_scores; // crn mode only, empty if the deck had cached battles
+    };
+
+    std::vector<std::vector<float>> last_battle_scores; // crn mode only: per deck evaluated by the last call
+    std::map<unsigned, PartialResults> partial_results; // the candidates of the last compare_many() that stopped early
+    std::unordered_map<std::string, std::pair<std::vector<Results<uint64_t>> , unsigned>> kept_results; // keep_results only, by cache_key()
+
+    void keep_battle_scores(bool first_part)
+    {
+        if(!use_crn) { return; }
+        if(first_part) { last_battle_scores.clear(); }
+        for(unsigned i(0); i < thread_progress.size(); ++i)
+        {
+            // only a deck that played all the battles, from the first one, can be a reference.
+            CompareProgress& progress(thread_progress[i]);
+            bool complete(thread_first_battles[i] == 0 && (!thread_compare || progress.num_committed_blocks == thread_num_blocks));
+            last_battle_scores.emplace_back(complete ? std::move(progress.battle_scores) : std::vector<float>());
+        }
+    }
+
+    // The key of the deck in the results cache: what tells apart the decks that may play differently.
+    std::string cache_key(const Deck* deck) const
+    {
+        std::stringstream key;
+        auto ids(deck->card_ids<std::vector<unsigned>>());
+        if(deck->strategy == DeckStrategy::random) { std::sort(ids.begin() + 1, ids.end()); }
+        key << deck->strategy;
+        for(unsigned id: ids) { key << ',' << id; }
+        key << ';' << (deck->fortress1 ? deck->fortress1->m_id : 0) << ',' << (deck->fortress2 ? deck->fortress2->m_id : 0) << ';';
+        for(unsigned id: deck->given_hand) { key << ',' << id; }
+        return(key.str());
+    }
+
+    std::pair<std::vector<Results<uint64_t>> , unsigned> cached_results(const Deck* deck) const
+    {
+        if(results_cache) { return(results_cache->find(cache_key(deck), def_decks.size())); }
+        auto kept(keep_results ? kept_results.find(cache_key(deck)) : kept_results.end());
+        if(kept != kept_results.end()) { return(kept->second); }
+        return(std::make_pair(std::vector<Results<uint64_t>>(def_decks.size()), 0u));
+    }
+
+    void store_results(const Deck* deck, const std::pair<std::vector<Results<uint64_t>> , unsigned>& results)
+    {
+        if(results_cache) { results_cache->add(cache_key(deck), results); }
+        else if(keep_results && results.second > 0)
+        {
+            auto& kept(kept_results[cache_key(deck)]);
+            kept.first.resize(results.first.size());
+            for(unsigned index(0); index < results.first.size(); ++index)
+            {
+                kept.first[index].merge(results.first[index]);
+            }
+            kept.second += results.second;
+        }
+    }
+
+    // crn mode: plays the first num_iterations battles of the deck again, only for their scores.
+    std::vector<float> replay_scores(unsigned num_iterations, const Deck* deck)
+    {
+        att_decks = {deck};
+        distribute(num_iterations, 0, false);
+        thread_compare = false;
+        // unlock all the threads
+        main_barrier.wait();
+        // wait for the threads
+        main_barrier.wait();
+        keep_battle_scores(true);
+        return(std::move(last_battle_scores[0]));
+    }
+
+    std::vector<std::pair<std::vector<Results<uint64_t>> , unsigned>> run_compare(unsigned num_iterations, long double prev_score, unsigned first_battle = 0)
+    {
+        distribute(num_iterations, first_battle);
         thread_prev_score = prev_score;
+        thread_paired_margin = paired_margin;
         thread_compare = true;
-        thread_compare_stop = false;
         // unlock all the threads
         main_barrier.wait();
         // wait for the threads
         main_barrier.wait();
-        return(std::make_pair(thread_results, thread_total));
+        // only the committed blocks count: the battles played past an early stop are dropped.
+        std::vector<std::pair<std::vector<Results<uint64_t>> , unsigned>> results;
+        for(auto& progress: thread_progress)
+        {
+            results.emplace_back(progress.results, progress.total);
+        }
+        return(results);
+    }
+
+    // Gives each thread an equal share of the blocks of battles; threads done early steal from the others.
+    // Chunks are capped so that compare() keeps checking whether it can stop early.
+    // The battles of each deck are numbered from first_battle plus the ones of the results cache (past_cached), so that they are all new.
+    void distribute(unsigned num_iterations, unsigned first_battle = 0, bool past_cached = true)
+    {
+        thread_num_battles = num_iterations;
+        thread_num_blocks = (num_iterations + battle_block_size - 1) / battle_block_size;
+        thread_num_resolved = 0;
+        thread_reference = use_crn && thread_reference_scores.size() == num_iterations ? &thread_reference_scores : nullptr;
+        thread_eval_seeds.resize(att_decks.size());
+        thread_progress.resize(att_decks.size());
+        thread_first_battles.resize(att_decks.size());
+        for(unsigned i(0); i < att_decks.size(); ++i)
+        {
+            thread_first_battles[i] = first_battle + (past_cached ? cached_results(att_decks[i]).second : 0);
+            // crn mode: every deck plays the same battles.
+            thread_eval_seeds[i] = mix_seed(mix_seed(sim_seed) + (use_crn ? 0 : num_evaluations++));
+            thread_progress[i].reset(num_iterations, def_decks.size());
+            // crn mode: the scores of the reference are the ones of the battles from the first one.
+            if(thread_first_battles[i] > 0) { thread_reference = nullptr; }
+        }
+        unsigned num_slots(thread_num_blocks * att_decks.size());
+        for(unsigned i(0), start(0); i < num_threads; ++i)
+        {
+            unsigned segment_size((num_slots + num_threads - 1 - i) / num_threads);
+            thread_segment_starts[i] = start;
+            battle_ranges[i].assign(start, start + segment_size);
+            start += segment_size;
+        }
+        thread_max_chunk = std::max(1u, std::min(4u, num_slots / (num_threads * 16)));
+    }
+
+    std::pair<std::vector<Results<uint64_t>> , unsigned> merge_results() const
+    {
+        std::vector<Results<uint64_t>> results(def_decks.size());
+        unsigned total(0);
+        for(auto data: threads_data)
+        {
+            for(unsigned index(0); index < results.size(); ++index)
+            {
+                results[index].merge(data->results[index]);
+            }
+            total += data->total;
+        }
+        return(std::make_pair(results, total));
     }
 };
 //------------------------------------------------------------------------------
+enum class CompareDecision
+{
+    undecided,
+    reject,
+    accept
+};
+//------------------------------------------------------------------------------
+// Compare mode: tells whether the deck can't beat prev_score (reject), surely beats it (accept),
+// or needs more battles, from the results committed so far.
+CompareDecision compare_decision(const std::vector<Results<uint64_t>>& results, unsigned total, const std::vector<long double>& factors, long double prev_score)
+{
+    long double best_possible = best_possible_points();
+    // Number of "wins", possibly fractional: the points scaled by the factors and by the best possible score.
+    long double successes = 0.0;
+    for(unsigned i = 0; i < results.size(); ++i)
+    {
+        successes += results[i].points * battle_scale(results[i], total) * factors[i];
+    }
+    successes /= std::accumulate(factors.begin(), factors.end(), .0) * best_possible;
+    long double prev_rate = std::min<long double>(1, prev_score / best_possible);
+    // Called under shared_mutex for every block: binomial is the only rule that doesn't take constant time.
+    switch(stop_rule)
+    {
+    case StopRule::binomial:
+        {
+            // Multiple defense decks case: approximation of a "discrete" number of events.
+            unsigned score_accum = successes * best_possible;
+            // Get a loose (better than no) upper bound.
+            if(boost::math::binomial_distribution<>::find_upper_bound_on_p(total, score_accum / best_possible, stop_alpha) * best_possible < prev_score)
+            { return(CompareDecision::reject); }
+            break;
+        }
+    case StopRule::sprt:
+        {
+            // H0: rate = prev_rate - delta, H1: rate = prev_rate + delta; the log likelihood ratio only depends on the sums.
+            // delta is 1%, less near 0% and 100% so that both rates stay meaningful.
+            long double delta = std::min<long double>(0.01, std::min(prev_rate, 1 - prev_rate) / 2);
+            if(delta <= 0) { break; }
+            long double rate0 = prev_rate - delta;
+            long double rate1 = prev_rate + delta;
+            long double llr = successes * log(rate1 / rate0) + (total - successes) * log((1 - rate1) / (1 - rate0));
+            if(llr <= log(stop_beta / (1 - stop_alpha))) { return(CompareDecision::reject); }
+            if(llr >= log((1 - stop_beta) / stop_alpha)) { return(CompareDecision::accept); }
+            break;
+        }
+    case StopRule::bayes:
+        {
+            // Uniform prior on the rate: the posterior is Beta(1 + successes, 1 + failures),
+            // taken as the normal distribution of the same mean and variance.
+            long double a = 1 + successes;
+            long double b = 1 + total - successes;
+            long double mean = a / (a + b);
+            long double stdev = sqrt(a * b / ((a + b) * (a + b) * (a + b + 1)));
+            if(mean + stop_z_alpha * stdev < prev_rate) { return(CompareDecision::reject); }
+            if(mean - stop_z_beta * stdev > prev_rate) { return(CompareDecision::accept); }
+            break;
+        }
+    }
+    return(CompareDecision::undecided);
+}
+//------------------------------------------------------------------------------
+// crn mode: tells whether the deck can't beat the reference deck plus margin anymore,
+// from the differences of their scores on the same battles.
+bool compare_stop_paired(long double diff_sum, long double diff_sq_sum, unsigned total, long double margin)
+{
+    if(total < 2 * battle_block_size) { return(false); }
+    long double mean = diff_sum / total;
+    long double variance = std::max<long double>(0, (diff_sq_sum - diff_sum * mean) / (total - 1));
+    // one-sided upper bound of the mean difference.
+    return(mean + stop_z_alpha * sqrt(variance / total) < margin);
+}
+//------------------------------------------------------------------------------
+// Claims the next chunk of slots for thread_id, stealing half of the largest
+// range left to another thread when its own range is exhausted.
+// Returns the number of slots claimed (0: nothing left to play), starting at slot first.
+unsigned claim_battles(std::vector<BattleRange>& battle_ranges, unsigned thread_id, unsigned& first)
+{
+    BattleRange& own_range(battle_ranges[thread_id]);
+    while(true)
+    {
+        unsigned num_claimed(own_range.claim(thread_max_chunk, first));
+        if(num_claimed > 0) { return(num_claimed); }
+        unsigned victim(thread_id);
+        unsigned victim_remaining(0);
+        for(unsigned i(0); i < battle_ranges.size(); ++i)
+        {
+            unsigned remaining(battle_ranges[i].remaining());
+            if(i != thread_id && remaining > victim_remaining)
+            {
+                victim = i;
+                victim_remaining = remaining;
+            }
+        }
+        if(victim_remaining == 0) { return(0); }
+        unsigned num_stolen(battle_ranges[victim].steal(first));
+        if(num_stolen > 0)
+        {
+            own_range.assign(first, first + num_stolen);
+        }
+    }
+}
+//------------------------------------------------------------------------------
+// Compare mode: commits the blocks of a candidate deck completed in order,
+// checking after each one whether the candidate can stop.
+// Returns whether the candidate is resolved.
+bool resolve_candidate(CompareProgress& progress, const std::vector<long double>& factors)
+{
+    for(auto next = progress.pending_blocks.begin(); !progress.stop && next != progress.pending_blocks.end() && next->first == progress.num_committed_blocks; next = progress.pending_blocks.erase(next))
+    {
+        for(unsigned index(0); index < progress.results.size(); ++index)
+        {
+            progress.results[index].merge(next->second.results[index]);
+        }
+        if(thread_reference)
+        {
+            for(unsigned battle(next->first * battle_block_size), last(battle + next->second.num_battles); battle < last; ++battle)
+            {
+                long double diff((long double)progress.battle_scores[battle] - (*thread_reference)[battle]);
+                progress.diff_sum += diff;
+                progress.diff_sq_sum += diff * diff;
+            }
+        }
+        progress.total += next->second.num_battles;
+        ++ progress.num_committed_blocks;
+        if(!thread_stop_early) { continue; }
+        auto decision(progress.total > 1 ? compare_decision(progress.results, progress.total, factors, thread_prev_score) : CompareDecision::undecided);
+        if(decision == CompareDecision::undecided && thread_reference &&
+            compare_stop_paired(progress.diff_sum, progress.diff_sq_sum, progress.total, thread_paired_margin))
+        {
+            decision = CompareDecision::reject;
+        }
+        if(decision != CompareDecision::undecided)
+        {
+            progress.stop = true;
+            progress.accepted = decision == CompareDecision::accept;
+        }
+    }
+    if(progress.stop && !progress.accepted) { return(true); }
+    if(!progress.accepted && progress.num_committed_blocks < thread_num_blocks) { return(false); }
+    // Accepted or fully evaluated: the next candidates have to beat this one too.
+    long double score(compute_score(std::make_pair(progress.results, progress.total), factors).points);
+    if(score > thread_prev_score)
+    {
+        thread_prev_score = score;
+        // crn mode: an accepted deck didn't play all the battles; keep the previous reference.
+        if(use_crn && !progress.accepted)
+        {
+            thread_reference = &progress.battle_scores;
+            thread_paired_margin = 0;
+        }
+    }
+    return(true);
+}
+//------------------------------------------------------------------------------
+// Compare mode: adds a block of battles of a candidate deck, then resolves what can be.
+// Must be called with shared_mutex locked.
+void commit_block(unsigned candidate, unsigned block, PendingBlock&& pending, const std::vector<long double>& factors)
+{
+    thread_progress[candidate].pending_blocks[block] = std::move(pending);
+    while(thread_num_resolved < thread_progress.size() && resolve_candidate(thread_progress[thread_num_resolved], factors))
+    {
+        ++ thread_num_resolved;
+    }
+}
+//------------------------------------------------------------------------------
 void thread_evaluate(boost::barrier& main_barrier,
                      boost::mutex& shared_mutex,
                      SimulationData& sim,
-                     const Process& p,
+                     Process& p,
                      unsigned thread_id)
 {
+    PendingBlock played;
     while(true)
     {
         main_barrier.wait();
-        sim.set_decks(p.att_deck, p.def_decks);
         if(destroy_threads) { return; }
+        sim.set_decks(p.att_decks, p.def_decks);
+        sim.reset_results();
         while(true)
         {
-            shared_mutex.lock(); //<<<<
-            if(thread_num_iterations == 0 || (thread_compare && thread_compare_stop)) //!
+            unsigned first(0);
+            unsigned num_claimed(claim_battles(p.battle_ranges, thread_id, first));
+            if(num_claimed == 0)
             {
-                shared_mutex.unlock(); //>>>>
                 main_barrier.wait();
                 break;
             }
-            else
+            for(unsigned slot(first); slot < first + num_claimed; ++slot)
             {
-                --thread_num_iterations; //!
-                shared_mutex.unlock(); //>>>>
-                std::vector<Results<uint64_t>> result{sim.evaluate()};
-                shared_mutex.lock(); //<<<<
-                std::vector<unsigned> thread_score_local(thread_results.size(), 0u); //!
-                for(unsigned index(0); index < result.size(); ++index)
+                unsigned block(slot_block(slot));
+                unsigned candidate(block / thread_num_blocks);
+                block -= candidate * thread_num_blocks;
+                CompareProgress& progress(thread_progress[candidate]);
+                if(thread_compare && progress.stop) { continue; }
+                unsigned battle(block * battle_block_size);
+                unsigned last(std::min(thread_num_battles, battle + battle_block_size));
+                played.results.assign(sim.results.size(), Results<uint64_t>{0, 0, 0, 0, 0});
+                played.num_battles = last - battle;
+                for(; battle < last; ++battle)
                 {
-                    thread_results[index] += result[index]; //!
-                    thread_score_local[index] = thread_results[index].points; //!
+                    long double score(sim.evaluate(played.results, candidate, battle));
+                    if(use_crn) { progress.battle_scores[battle] = score; }
                 }
-                ++thread_total; //!
-                unsigned thread_total_local{thread_total}; //!
-                shared_mutex.unlock(); //>>>>
-                if(thread_compare && thread_id == 0 && thread_total_local > 1)
+                if(thread_compare)
                 {
-                    unsigned score_accum = 0;
-                    // Multiple defense decks case: scaling by factors and approximation of a "discrete" number of events.
-                    if(result.size() > 1)
-                    {
-                        long double score_accum_d = 0.0;
-                        for(unsigned i = 0; i < thread_score_local.size(); ++i)
-                        {
-                            score_accum_d += thread_score_local[i] * sim.factors[i];
-                        }
-                        score_accum_d /= std::accumulate(sim.factors.begin(), sim.factors.end(), .0);
-                        score_accum = score_accum_d;
-                    }
-                    else
+                    shared_mutex.lock(); //<<<<
+                    commit_block(candidate, block, std::move(played), sim.factors); //!
+                    shared_mutex.unlock(); //>>>>
+                }
+                else
+                {
+                    for(unsigned index(0); index < sim.results.size(); ++index)
                     {
-                        score_accum = thread_score_local[0];
-                    }
-                    bool compare_stop(false);
-                    long double best_possible = (optimization_mode == OptimizationMode::raid ? 250 : optimization_mode == OptimizationMode::gw_abp ? 79 : 100);
-                    // Get a loose (better than no) upper bound. TODO: Improve it.
-                    compare_stop = (boost::math::binomial_distribution<>::find_upper_bound_on_p(thread_total_local, score_accum / best_possible, 0.01) * best_possible < thread_prev_score);
-                    if(compare_stop) {
-                        shared_mutex.lock(); //<<<<
-                        //std::cout << thread_total_local << "\n";
-                        thread_compare_stop = true; //!
-                        shared_mutex.unlock(); //>>>>
+                        sim.results[index].merge(played.results[index]);
                     }
+                    sim.total += played.num_battles;
                 }
             }
         }
@@ -509,6 +1296,17 @@ void print_results(const std::pair<std::vector<Results<uint64_t>> , unsigned>& r
     }
     std::cout << "/ " << results.second << ")" << std::endl;
 
+    if(!thread_def_ratios.empty())
+    {
+        // +strat: the counts above are out of the battles each enemy deck played.
+        std::cout << "battles: (";
+        for(auto val: results.first)
+        {
+            std::cout << val.battles << " ";
+        }
+        std::cout << "/ " << results.second << ")" << std::endl;
+    }
+
     switch(optimization_mode)
     {
         case OptimizationMode::raid:
@@ -637,208 +1435,412 @@ void print_deck_inline2(const Card *commander, std::vector<const Card*> cards, b
 }
 
 //------------------------------------------------------------------------------
-void hill_climbing(unsigned num_iterations, Deck* d1, Process& proc, std::map<signed, char> card_marks)
+// Memo of the climbs: the battles played with each deck evaluated.
+// The key of a deck is a sum of pseudo-random 64-bit terms, one per card (Zobrist hashing), so that changing a card
+// only changes its term; in ordered decks the term of a card depends on its slot too.
+// The table is open-addressed with linear probing, key 0 marks the free entries.
+class DeckMemo
 {
-    auto results = proc.evaluate(num_iterations);
-    print_score_info(results, proc.factors);
-    auto current_score = compute_score(results, proc.factors);
-    auto best_score = current_score;
-    std::map<std::multiset<unsigned>, unsigned> evaluated_decks{{d1->card_ids<std::multiset<unsigned>>(),  num_iterations}};
-    // Non-commander cards
-    auto non_commander_cards = proc.cards.player_assaults;
-    non_commander_cards.insert(non_commander_cards.end(), proc.cards.player_structures.begin(), proc.cards.player_structures.end());
-    non_commander_cards.insert(non_commander_cards.end(), proc.cards.player_actions.begin(), proc.cards.player_actions.end());
-    non_commander_cards.insert(non_commander_cards.end(), std::initializer_list<Card *>{NULL,});
-    const Card* best_commander = d1->commander;
-    std::vector<const Card*> best_cards = d1->cards;
-    unsigned deck_cost = get_deck_cost(d1, proc.cards);
-    fund = std::max(fund, deck_cost);
-    print_deck_inline(deck_cost, best_score, best_commander, best_cards, false);
-    std::mt19937 re(time(NULL));
-    bool deck_has_been_improved = true;
-    unsigned long skipped_simulations = 0;
-    for(unsigned slot_i(0), dead_slot(0); (deck_has_been_improved || slot_i != dead_slot) && best_score.points - target_score < -1e-9; slot_i = (slot_i + 1) % std::min<unsigned>(max_deck_len, best_cards.size() + 1))
+public:
+    DeckMemo(bool is_ordered) :
+        m_is_ordered(is_ordered),
+        m_entries(1 << 10),
+        m_size(0)
     {
-        if(card_marks.count(slot_i)) { continue; }
-        if(deck_has_been_improved)
+    }
+
+    uint64_t commander_term(const Card* commander) const
+    {
+        return(term(commander, 0));
+    }
+
+    uint64_t card_term(const Card* card, unsigned slot) const
+    {
+        return(term(card, m_is_ordered ? slot + 1 : 1));
+    }
+
+    uint64_t key(const Deck& deck) const
+    {
+        uint64_t key(commander_term(deck.commander));
+        for(unsigned slot(0); slot < deck.cards.size(); ++slot)
         {
-            dead_slot = slot_i;
-            deck_has_been_improved = false;
+            key += card_term(deck.cards[slot], slot);
+        }
+        return(key);
+    }
+
+    // The key of a deck with new_cards, from the key of the same deck with old_cards, both the same up to first_slot.
+    uint64_t key(uint64_t old_key, const std::vector<const Card*>& old_cards, const std::vector<const Card*>& new_cards, unsigned first_slot) const
+    {
+        uint64_t key(old_key);
+        for(unsigned slot(first_slot); slot < old_cards.size(); ++slot)
+        {
+            key -= card_term(old_cards[slot], slot);
+        }
+        for(unsigned slot(first_slot); slot < new_cards.size(); ++slot)
+        {
+            key += card_term(new_cards[slot], slot);
         }
-        if(!card_marks.count(-1))
+        return(key);
+    }
+
+    bool count(uint64_t key) const
+    {
+        return(m_entries[find(key)].first != 0);
+    }
+
+    unsigned& operator[](uint64_t key)
+    {
+        if(2 * (m_size + 1) > m_entries.size())
+        {
+            grow();
+        }
+        auto& entry(m_entries[find(key)]);
+        if(entry.first == 0)
+        {
+            entry.first = key ? key : 1;
+            ++ m_size;
+        }
+        return(entry.second);
+    }
+
+    std::size_t size() const
+    {
+        return(m_size);
+    }
+
+    unsigned long num_battles() const
+    {
+        unsigned long num_battles(0);
+        for(auto& entry: m_entries) { num_battles += entry.second; }
+        return(num_battles);
+    }
+
+private:
+    bool m_is_ordered;
+    std::vector<std::pair<uint64_t, unsigned>> m_entries; // key, battles; the size is a power of 2
+    std::size_t m_size;
+
+    static uint64_t term(const Card* card, unsigned slot)
+    {
+        return(mix_seed(((uint64_t)slot << 32) + card->m_id));
+    }
+
+    // The entry of key, or the free entry where it goes.
+    std::size_t find(uint64_t key) const
+    {
+        if(key == 0) { key = 1; }
+        std::size_t mask(m_entries.size() - 1);
+        std::size_t index(key & mask);
+        while(m_entries[index].first != 0 && m_entries[index].first != key)
         {
-            for(const Card* commander_candidate: proc.cards.player_commanders)
+            index = (index + 1) & mask;
+        }
+        return(index);
+    }
+
+    void grow()
+    {
+        std::vector<std::pair<uint64_t, unsigned>> entries(m_entries.size() * 2);
+        std::swap(entries, m_entries);
+        for(auto& entry: entries)
+        {
+            if(entry.first != 0) { m_entries[find(entry.first)] = entry; }
+        }
+    }
+};
+//------------------------------------------------------------------------------
+// Racing (successive halving): plays a few battles with every candidate, keeps the better half
+// of those which can still beat best_score, plays as many new battles again, and so on.
+// Returns the index of the last candidate standing, or candidate_decks.size() if none can beat best_score.
+unsigned race_candidates(unsigned num_iterations, Process& proc, const std::vector<Deck>& candidate_decks, DeckMemo& evaluated_decks, long double best_score)
+{
+    std::vector<std::pair<std::vector<Results<uint64_t>> , unsigned>> results(candidate_decks.size(),
+        std::make_pair(std::vector<Results<uint64_t>>(proc.factors.size(), Results<uint64_t>{0, 0, 0, 0, 0}), 0u));
+    std::vector<unsigned> survivors;
+    for(unsigned i(0); i < candidate_decks.size(); ++i) { survivors.push_back(i); }
+    unsigned num_rounds(ceil(log2(candidate_decks.size())));
+    unsigned num_battles(std::max(race_min_battles, num_iterations >> std::min(num_rounds, 31u)));
+    for(unsigned played(0); survivors.size() > 1 && played < num_iterations; played += num_battles, num_battles = played)
+    {
+        num_battles = std::min(num_battles, num_iterations - played);
+        std::vector<const Deck*> decks;
+        for(unsigned i: survivors) { decks.push_back(&candidate_decks[i]); }
+        auto round_results = proc.evaluate_many(decks, num_battles, played);
+        std::vector<std::pair<long double, unsigned>> ranking;
+        for(unsigned k(0); k < survivors.size(); ++k)
+        {
+            auto& result(results[survivors[k]]);
+            for(unsigned index(0); index < result.first.size(); ++index)
             {
-                // Various checks to check if the card is accepted
-                assert(commander_candidate->m_type == CardType::commander);
-                if(commander_candidate->m_name == best_commander->m_name) { continue; }
-                // Place it in the deck
-                d1->commander = commander_candidate;
-                auto &&cur_deck = d1->card_ids<std::multiset<unsigned>>();
-                if(evaluated_decks.count(cur_deck) == 0)
-                {
-                    deck_cost = get_deck_cost(d1, proc.cards);
-                    if(deck_cost > fund) { continue; }
-                    // Evaluate new deck
-                    auto compare_results = proc.compare(num_iterations, best_score.points);
-                    current_score = compute_score(compare_results, proc.factors);
-                    evaluated_decks[cur_deck] = compare_results.second;
-                    // Is it better ?
-                    if(current_score.points > best_score.points)
-                    {
-                        // Then update best score/commander, print stuff
-                        best_score = current_score;
-                        best_commander = commander_candidate;
-                        deck_has_been_improved = true;
-                        std::cout << "Deck improved: " << deck_hash(commander_candidate, best_cards, false) << " commander -> " << card_id_name(commander_candidate) << ": ";
-                        print_score_info(compare_results, proc.factors);
-                        print_deck_inline(deck_cost, best_score, best_commander, best_cards, false);
-                    }
-                }
-                else
-                {
-                    skipped_simulations += evaluated_decks[cur_deck];
-                }
+                result.first[index].merge(round_results[k].first[index]);
+            }
+            result.second += round_results[k].second;
+            evaluated_decks[evaluated_decks.key(candidate_decks[survivors[k]])] = result.second;
+            if(compare_decision(result.first, result.second, proc.factors, best_score) != CompareDecision::reject)
+            {
+                ranking.emplace_back(-compute_score(result, proc.factors).points, survivors[k]);
+            }
+        }
+        std::sort(ranking.begin(), ranking.end());
+        survivors.clear();
+        for(unsigned k(0); k < (ranking.size() + 1) / 2; ++k) { survivors.push_back(ranking[k].second); }
+    }
+    return(survivors.empty() ? candidate_decks.size() : survivors[0]);
+}
+//------------------------------------------------------------------------------
+// Evaluates the candidate decks at once and records them in evaluated_decks.
+// Returns the index of the best candidate if it beats best_score, updating best_score and best_results
+// (and raising num_iterations if the new best deck needs more battles for climb ci=<num>);
+// returns candidate_decks.size() otherwise.
+unsigned select_best_candidate(unsigned& num_iterations, Process& proc, const std::vector<Deck>& candidate_decks, DeckMemo& evaluated_decks, Results<long double>& best_score, std::pair<std::vector<Results<uint64_t>> , unsigned>& best_results)
+{
+    if(use_racing && candidate_decks.size() > 2)
+    {
+        // +race: only the winner of the race is evaluated as usual.
+        unsigned winner(race_candidates(num_iterations, proc, candidate_decks, evaluated_decks, best_score.points));
+        if(winner == candidate_decks.size()) { return(winner); }
+        uint64_t winner_key(evaluated_decks.key(candidate_decks[winner]));
+        unsigned raced_battles(evaluated_decks[winner_key]);
+        std::vector<Deck> finalist{candidate_decks[winner]};
+        bool improved(select_best_candidate(num_iterations, proc, finalist, evaluated_decks, best_score, best_results) == 0);
+        evaluated_decks[winner_key] += raced_battles;
+        return(improved ? winner : candidate_decks.size());
+    }
+    unsigned best_index(candidate_decks.size());
+    auto candidate_score = best_score;
+    auto compare_results = proc.compare_many(candidate_decks, num_iterations, best_score.points);
+    for(unsigned i(0); i < candidate_decks.size(); ++i)
+    {
+        evaluated_decks[evaluated_decks.key(candidate_decks[i])] = compare_results[i].second;
+        auto current_score = compute_score(compare_results[i], proc.factors);
+        if(current_score.points > candidate_score.points)
+        {
+            candidate_score = current_score;
+            best_index = i;
+        }
+    }
+    if(best_index == candidate_decks.size()) { return(best_index); }
+    if(compare_results[best_index].second < num_iterations)
+    {
+        // Accepted early: its battles are topped up to num_iterations, the next candidates will be compared with its score.
+        proc.complete_partial(best_index, num_iterations, compare_results[best_index]);
+        evaluated_decks[evaluated_decks.key(candidate_decks[best_index])] = compare_results[best_index].second;
+        candidate_score = compute_score(compare_results[best_index], proc.factors);
+        if(candidate_score.points <= best_score.points) { return(candidate_decks.size()); }
+        proc.use_last_as_reference();
+    }
+    else
+    {
+        proc.use_last_as_reference(best_index);
+    }
+    // crn mode: a candidate with battles from the results cache didn't play them all.
+    if(use_crn && thread_reference_scores.empty()) { proc.use_as_reference(num_iterations, &candidate_decks[best_index]); }
+    best_score = candidate_score;
+    best_results = compare_results[best_index];
+    if(climb_ci > 0)
+    {
+        num_iterations = std::max(num_iterations, battles_for_ci(best_results, proc.factors, climb_ci));
+    }
+    return(best_index);
+}
+//------------------------------------------------------------------------------
+// Hill-climbing from a deck, one slot per step: the best commander, then the best card for the slot
+// (the best card moved from the slot anywhere in ordered decks), until a sweep of all the slots improves nothing.
+// climb runs one of them, climb -starts <num> several in turn (see climb_from_starts()).
+class ClimbTrajectory
+{
+public:
+    const bool is_ordered;
+    std::string name; // printed first on its lines, empty when it runs alone
+    unsigned num_iterations;
+    const Card* best_commander;
+    std::vector<const Card*> best_cards;
+    Results<long double> best_score;
+    std::pair<std::vector<Results<uint64_t>> , unsigned> best_results;
+    unsigned num_steps{0};
+    bool abandoned{false};
+
+    ClimbTrajectory(unsigned num_iterations_, const Deck& deck_, Process& proc, const std::map<signed, char>& card_marks_, unsigned seed_offset, const std::string& name_) :
+        is_ordered(deck_.strategy != DeckStrategy::random),
+        name(name_),
+        num_iterations(num_iterations_),
+        best_commander(deck_.commander),
+        best_cards(deck_.cards),
+        deck(deck_),
+        evaluated_decks(is_ordered),
+        card_marks(card_marks_),
+        re(sim_seed + seed_offset)
+    {
+        best_results = proc.evaluate_cached(num_iterations, &deck);
+        proc.use_last_as_reference();
+        reference_scores.swap(thread_reference_scores);
+        std::cout << name;
+        print_score_info(best_results, proc.factors);
+        best_score = compute_score(best_results, proc.factors);
+        evaluated_decks[evaluated_decks.key(deck)] = num_iterations;
+        // Non-commander cards
+        non_commander_cards = proc.cards.player_assaults;
+        non_commander_cards.insert(non_commander_cards.end(), proc.cards.player_structures.begin(), proc.cards.player_structures.end());
+        non_commander_cards.insert(non_commander_cards.end(), proc.cards.player_actions.begin(), proc.cards.player_actions.end());
+        non_commander_cards.insert(non_commander_cards.end(), std::initializer_list<Card *>{NULL,});
+        unsigned deck_cost = get_deck_cost(&deck, proc.cards);
+        fund = std::max(fund, deck_cost);
+        std::cout << name;
+        print_deck_inline(deck_cost, best_score, best_commander, best_cards, is_ordered);
+    }
+
+    bool done() const
+    {
+        return(abandoned || (!deck_has_been_improved && slot_i == dead_slot) || best_score.points - target_score >= -1e-9);
+    }
+
+    // One slot. In crn mode, the candidates are compared with the best deck of this climb.
+    void step(Process& proc)
+    {
+        thread_reference_scores.swap(reference_scores);
+        if(is_ordered) { step_ordered(proc); }
+        else if(!card_marks.count(slot_i)) { step_random(proc); }
+        thread_reference_scores.swap(reference_scores);
+        slot_i = (slot_i + 1) % std::min<unsigned>(max_deck_len, best_cards.size() + 1);
+        ++ num_steps;
+    }
+
+    void print_evaluated() const
+    {
+        std::cout << name << "Evaluated " << evaluated_decks.size() << " decks (" << evaluated_decks.num_battles() << " + " << skipped_simulations << " simulations)." << std::endl;
+    }
+
+private:
+    Deck deck; // scratch: the best deck between the steps
+    DeckMemo evaluated_decks;
+    std::map<signed, char> card_marks;
+    std::vector<Card*> non_commander_cards;
+    std::mt19937 re;
+    std::vector<float> reference_scores; // crn mode only
+    bool deck_has_been_improved{true};
+    unsigned slot_i{0};
+    unsigned dead_slot{0};
+    unsigned long skipped_simulations{0};
+
+    void step_commander(Process& proc, uint64_t& best_key)
+    {
+        std::vector<Deck> candidate_decks;
+        for(const Card* commander_candidate: proc.cards.player_commanders)
+        {
+            // Various checks to check if the card is accepted
+            assert(commander_candidate->m_type == CardType::commander);
+            if(commander_candidate->m_name == best_commander->m_name) { continue; }
+            // Place it in the deck
+            deck.commander = commander_candidate;
+            uint64_t cur_deck(best_key - evaluated_decks.commander_term(best_commander) + evaluated_decks.commander_term(commander_candidate));
+            assert(cur_deck == evaluated_decks.key(deck));
+            if(evaluated_decks.count(cur_deck) == 0)
+            {
+                if(get_deck_cost(&deck, proc.cards) > fund) { continue; }
+                candidate_decks.emplace_back(deck);
+            }
+            else
+            {
+                skipped_simulations += evaluated_decks[cur_deck];
             }
-            // Now that all commanders are evaluated, take the best one
-            d1->commander = best_commander;
         }
+        // Evaluate all the new decks, then take the best one
+        auto best_index = select_best_candidate(num_iterations, proc, candidate_decks, evaluated_decks, best_score, best_results);
+        if(best_index < candidate_decks.size())
+        {
+            // Then update best commander, print stuff
+            best_commander = candidate_decks[best_index].commander;
+            deck_has_been_improved = true;
+            std::cout << name << "Deck improved: " << deck_hash(best_commander, best_cards, is_ordered) << " commander -> " << card_id_name(best_commander) << ": ";
+            print_score_info(best_results, proc.factors);
+            print_deck_inline(get_deck_cost(&candidate_decks[best_index], proc.cards), best_score, best_commander, best_cards, is_ordered);
+        }
+        deck.commander = best_commander;
+        best_key = evaluated_decks.key(deck);
+    }
+
+    void step_random(Process& proc)
+    {
+        if(deck_has_been_improved)
+        {
+            dead_slot = slot_i;
+            deck_has_been_improved = false;
+        }
+        uint64_t best_key(evaluated_decks.key(deck));
+        if(!card_marks.count(-1)) { step_commander(proc, best_key); }
         std::shuffle(non_commander_cards.begin(), non_commander_cards.end(), re);
+        std::vector<Deck> candidate_decks;
+        std::vector<const Card*> candidate_cards;
         for(const Card* card_candidate: non_commander_cards)
         {
-            d1->cards = best_cards;
+            deck.cards = best_cards;
             if(card_candidate)
             {
                 // Various checks to check if the card is accepted
                 assert(card_candidate->m_type != CardType::commander);
                 if(slot_i < best_cards.size() && card_candidate->m_name == best_cards[slot_i]->m_name) { continue; }
-                if(!suitable_non_commander(*d1, slot_i, card_candidate)) { continue; }
+                if(!suitable_non_commander(deck, slot_i, card_candidate)) { continue; }
                 // Place it in the deck
-                if(slot_i == d1->cards.size())
+                if(slot_i == deck.cards.size())
                 {
-                    d1->cards.emplace_back(card_candidate);
+                    deck.cards.emplace_back(card_candidate);
                 }
                 else
                 {
-                    d1->cards[slot_i] = card_candidate;
+                    deck.cards[slot_i] = card_candidate;
                 }
             }
             else
             {
                 if(best_cards.size() <= min_deck_len || slot_i == best_cards.size()) { continue; }
                 // Remove it from the deck
-                d1->cards.erase(d1->cards.begin() + slot_i);
+                deck.cards.erase(deck.cards.begin() + slot_i);
             }
-            auto &&cur_deck = d1->card_ids<std::multiset<unsigned>>();
+            uint64_t cur_deck(best_key);
+            if(slot_i < best_cards.size()) { cur_deck -= evaluated_decks.card_term(best_cards[slot_i], slot_i); }
+            if(card_candidate) { cur_deck += evaluated_decks.card_term(card_candidate, slot_i); }
+            assert(cur_deck == evaluated_decks.key(deck));
             if(evaluated_decks.count(cur_deck) == 0)
             {
-                deck_cost = get_deck_cost(d1, proc.cards);
-                if(deck_cost > fund) { continue; }
-                // Evaluate new deck
-                auto compare_results = proc.compare(num_iterations, best_score.points);
-                current_score = compute_score(compare_results, proc.factors);
-                evaluated_decks[cur_deck] = compare_results.second;
-                // Is it better ?
-                if(current_score.points > best_score.points)
-                {
-                    std::cout << "Deck improved: " << deck_hash(best_commander, d1->cards, false) << " " << card_id_name(slot_i < best_cards.size() ? best_cards[slot_i] : NULL) <<
-                        " -> " << card_id_name(card_candidate) << ": ";
-                    // Then update best score/slot, print stuff
-                    best_score = current_score;
-                    best_cards = d1->cards;
-                    deck_has_been_improved = true;
-                    print_score_info(compare_results, proc.factors);
-                    print_deck_inline(deck_cost, best_score, best_commander, best_cards, false);
-                }
+                if(get_deck_cost(&deck, proc.cards) > fund) { continue; }
+                candidate_decks.emplace_back(deck);
+                candidate_cards.emplace_back(card_candidate);
             }
             else
             {
                 skipped_simulations += evaluated_decks[cur_deck];
             }
-            if(best_score.points - target_score > -1e-9) { break; }
         }
-        d1->cards = best_cards;
+        // Evaluate all the new decks for this slot, then take the best one
+        auto best_index = select_best_candidate(num_iterations, proc, candidate_decks, evaluated_decks, best_score, best_results);
+        if(best_index < candidate_decks.size())
+        {
+            const Deck& best_deck(candidate_decks[best_index]);
+            std::cout << name << "Deck improved: " << deck_hash(best_commander, best_deck.cards, false) << " " << card_id_name(slot_i < best_cards.size() ? best_cards[slot_i] : NULL) <<
+                " -> " << card_id_name(candidate_cards[best_index]) << ": ";
+            // Then update best slot, print stuff
+            best_cards = best_deck.cards;
+            deck_has_been_improved = true;
+            print_score_info(best_results, proc.factors);
+            print_deck_inline(get_deck_cost(&best_deck, proc.cards), best_score, best_commander, best_cards, false);
+        }
+        deck.cards = best_cards;
     }
-    unsigned simulations = 0;
-    for(auto evaluation: evaluated_decks)
-    { simulations += evaluation.second; }
-    std::cout << "Evaluated " << evaluated_decks.size() << " decks (" << simulations << " + " << skipped_simulations << " simulations)." << std::endl;
-    std::cout << "Optimized Deck: ";
-    print_deck_inline(get_deck_cost(d1, proc.cards), best_score, best_commander, best_cards, false);
-}
-//------------------------------------------------------------------------------
-void hill_climbing_ordered(unsigned num_iterations, Deck* d1, Process& proc, std::map<signed, char> card_marks)
-{
-    auto results = proc.evaluate(num_iterations);
-    print_score_info(results, proc.factors);
-    auto current_score = compute_score(results, proc.factors);
-    auto best_score = current_score;
-    std::map<std::vector<unsigned>, unsigned> evaluated_decks{{d1->card_ids<std::vector<unsigned>>(), num_iterations}};
-    // Non-commander cards
-    auto non_commander_cards = proc.cards.player_assaults;
-    non_commander_cards.insert(non_commander_cards.end(), proc.cards.player_structures.begin(), proc.cards.player_structures.end());
-    non_commander_cards.insert(non_commander_cards.end(), proc.cards.player_actions.begin(), proc.cards.player_actions.end());
-    non_commander_cards.insert(non_commander_cards.end(), std::initializer_list<Card *>{NULL,});
-    const Card* best_commander = d1->commander;
-    std::vector<const Card*> best_cards = d1->cards;
-    unsigned deck_cost = get_deck_cost(d1, proc.cards);
-    fund = std::max(fund, deck_cost);
-    print_deck_inline(deck_cost, best_score, best_commander, best_cards, true);
-    std::mt19937 re(time(NULL));
-    bool deck_has_been_improved = true;
-    unsigned long skipped_simulations = 0;
-    for(unsigned from_slot(0), dead_slot(0); (deck_has_been_improved || from_slot != dead_slot) && best_score.points - target_score < -1e-9; from_slot = (from_slot + 1) % std::min<unsigned>(max_deck_len, d1->cards.size() + 1))
+
+    void step_ordered(Process& proc)
     {
+        unsigned from_slot(slot_i);
         if(deck_has_been_improved)
         {
             dead_slot = from_slot;
             deck_has_been_improved = false;
         }
-        if(!card_marks.count(-1))
-        {
-            for(const Card* commander_candidate: proc.cards.player_commanders)
-            {
-                if(best_score.points - target_score > -1e-9) { break; }
-                // Various checks to check if the card is accepted
-                assert(commander_candidate->m_type == CardType::commander);
-                if(commander_candidate->m_name == best_commander->m_name) { continue; }
-                // Place it in the deck
-                d1->commander = commander_candidate;
-                auto &&cur_deck = d1->card_ids<std::vector<unsigned>>();
-                if(evaluated_decks.count(cur_deck) == 0)
-                {
-                    deck_cost = get_deck_cost(d1, proc.cards);
-                    if(deck_cost > fund) { continue; }
-                    // Evaluate new deck
-                    auto compare_results = proc.compare(num_iterations, best_score.points);
-                    current_score = compute_score(compare_results, proc.factors);
-                    evaluated_decks[cur_deck] = compare_results.second;
-                    // Is it better ?
-                    if(current_score.points > best_score.points)
-                    {
-                        // Then update best score/commander, print stuff
-                        best_score = current_score;
-                        best_commander = commander_candidate;
-                        deck_has_been_improved = true;
-                        std::cout << "Deck improved: " << deck_hash(commander_candidate, best_cards, true) << " commander -> " << card_id_name(commander_candidate) << ": ";
-                        print_score_info(compare_results, proc.factors);
-                        print_deck_inline(deck_cost, best_score, best_commander, best_cards, true);
-                    }
-                    //else{
-                    //    std::cout << "Deck tested but not improved: "; //<< deck_hash(commander_candidate, best_cards, true) << " commander -> " << card_id_name(commander_candidate) << ": ";
-                    //    print_score_info(compare_results, proc.factors);
-                    //    print_deck_inline(deck_cost, current_score, commander_candidate, best_cards, true);
-                    //}
-                }
-                else
-                {
-                    skipped_simulations += evaluated_decks[cur_deck];
-                }
-            }
-            // Now that all commanders are evaluated, take the best one
-            d1->commander = best_commander;
-        }
+        uint64_t best_key(evaluated_decks.key(deck));
+        if(!card_marks.count(-1)) { step_commander(proc, best_key); }
         std::shuffle(non_commander_cards.begin(), non_commander_cards.end(), re);
+        std::vector<Deck> candidate_decks;
+        std::vector<std::pair<const Card*, unsigned>> candidate_moves; // card, to_slot
         for(const Card* card_candidate: non_commander_cards)
         {
             // Various checks to check if the card is accepted
@@ -846,88 +1848,410 @@ void hill_climbing_ordered(unsigned num_iterations, Deck* d1, Process& proc, std
             for(unsigned to_slot(card_candidate ? 0 : best_cards.size() - 1); to_slot < best_cards.size() + (from_slot < best_cards.size() ? 0 : 1); ++to_slot)
             {
                 if(card_marks.count(from_slot) && card_candidate != best_cards[from_slot]) { break; }
-                d1->cards = best_cards;
+                deck.cards = best_cards;
                 if(card_candidate)
                 {
                     // Various checks to check if the card is accepted
-                    if(!suitable_non_commander(*d1, from_slot, card_candidate)) { continue; }
+                    if(!suitable_non_commander(deck, from_slot, card_candidate)) { continue; }
                     // Place it in the deck
                     if(from_slot < best_cards.size())
                     {
                         if(from_slot == to_slot && card_candidate->m_name == best_cards[to_slot]->m_name) { continue; }
-                        d1->cards.erase(d1->cards.begin() + from_slot);
+                        deck.cards.erase(deck.cards.begin() + from_slot);
                     }
-                    d1->cards.insert(d1->cards.begin() + to_slot, card_candidate);
+                    deck.cards.insert(deck.cards.begin() + to_slot, card_candidate);
                 }
                 else
                 {
                     if(best_cards.size() <= min_deck_len || from_slot == best_cards.size()) { continue; }
                     // Remove it from the deck
-                    d1->cards.erase(d1->cards.begin() + from_slot);
+                    deck.cards.erase(deck.cards.begin() + from_slot);
                 }
-                auto &&cur_deck = d1->card_ids<std::vector<unsigned>>();
+                uint64_t cur_deck(evaluated_decks.key(best_key, best_cards, deck.cards, std::min(from_slot, to_slot)));
+                assert(cur_deck == evaluated_decks.key(deck));
                 if(evaluated_decks.count(cur_deck) == 0)
                 {
-                    deck_cost = get_deck_cost(d1, proc.cards);
-                    if(deck_cost > fund) { continue; }
-                    // Evaluate new deck
-                    auto compare_results = proc.compare(num_iterations, best_score.points);
-                    current_score = compute_score(compare_results, proc.factors);
-                    evaluated_decks[cur_deck] = compare_results.second;
-                    // Is it better ?
-                    if(current_score.points > best_score.points)
-                    {
-                        // Then update best score/slot, print stuff
-                        std::cout << "Deck improved: " << deck_hash(best_commander, d1->cards, true) << " " << from_slot << " " << card_id_name(from_slot < best_cards.size() ? best_cards[from_slot] : NULL) <<
-                            " -> " << to_slot << " " << card_id_name(card_candidate) << ": ";
-                        best_score = current_score;
-                        best_cards = d1->cards;
-                        deck_has_been_improved = true;
-                        print_score_info(compare_results, proc.factors);
-                        print_deck_inline(deck_cost, best_score, best_commander, best_cards, true);
-                        std::map<signed, char> new_card_marks;
-                        for(auto it: card_marks)
-                        {
-                            signed pos = it.first;
-                            char mark = it.second;
-                            if(pos < 0) {}
-                            else if(static_cast<unsigned>(pos) == from_slot)
-                            {
-                                pos = to_slot;
-                            }
-                            else
-                            {
-                                if(static_cast<unsigned>(pos) > from_slot) { -- pos; }
-                                if(static_cast<unsigned>(pos) >= to_slot) { ++ pos; }
-                            }
-                            new_card_marks[pos] = mark;
-                        }
-                        card_marks = new_card_marks;
-                    }
-                    //else{
-                        //std::cout << "Deck tested but not improved: "; << deck_hash(commander_candidate, best_cards, true) << " commander -> " << card_id_name(commander_candidate) << ": ";
-                        //std::cout << "Deck tested but not improved: " << deck_hash(best_commander, d1->cards, true) << " " << from_slot << " " << card_id_name(from_slot < best_cards.size() ? best_cards[from_slot] : NULL) <<
-                        //    " -> " << to_slot << " " << card_id_name(card_candidate) << ": ";
-                        //print_score_info(compare_results, proc.factors);
-                        //print_deck_inline(deck_cost, current_score, best_commander, d1->cards, true);
-                    //}
+                    if(get_deck_cost(&deck, proc.cards) > fund) { continue; }
+                    // mark it, so that the same order isn't submitted twice
+                    evaluated_decks[cur_deck] = 0;
+                    candidate_decks.emplace_back(deck);
+                    candidate_moves.emplace_back(card_candidate, to_slot);
                 }
                 else
                 {
-                    //print_deck_inline2(best_commander, d1->cards, true);
+                    //print_deck_inline2(best_commander, deck.cards, true);
                     skipped_simulations += evaluated_decks[cur_deck];
                 }
             }
-            if(best_score.points - target_score > -1e-9) { break; }
         }
-        d1->cards = best_cards;
+        // Evaluate all the new decks for this slot, then take the best one
+        auto best_index = select_best_candidate(num_iterations, proc, candidate_decks, evaluated_decks, best_score, best_results);
+        if(best_index < candidate_decks.size())
+        {
+            const Deck& best_deck(candidate_decks[best_index]);
+            const Card* card_candidate(candidate_moves[best_index].first);
+            unsigned to_slot(candidate_moves[best_index].second);
+            // Then update best slot, print stuff
+            std::cout << name << "Deck improved: " << deck_hash(best_commander, best_deck.cards, true) << " " << from_slot << " " << card_id_name(from_slot < best_cards.size() ? best_cards[from_slot] : NULL) <<
+                " -> " << to_slot << " " << card_id_name(card_candidate) << ": ";
+            best_cards = best_deck.cards;
+            deck_has_been_improved = true;
+            print_score_info(best_results, proc.factors);
+            print_deck_inline(get_deck_cost(&best_deck, proc.cards), best_score, best_commander, best_cards, true);
+            std::map<signed, char> new_card_marks;
+            for(auto it: card_marks)
+            {
+                signed pos = it.first;
+                char mark = it.second;
+                if(pos < 0) {}
+                else if(static_cast<unsigned>(pos) == from_slot)
+                {
+                    pos = to_slot;
+                }
+                else
+                {
+                    if(static_cast<unsigned>(pos) > from_slot) { -- pos; }
+                    if(static_cast<unsigned>(pos) >= to_slot) { ++ pos; }
+                }
+                new_card_marks[pos] = mark;
+            }
+            card_marks = new_card_marks;
+        }
+        deck.cards = best_cards;
+    }
+};
+//------------------------------------------------------------------------------
+// Random changes of a deck, for anneal and evolve: a card replaced, added or removed, the commander changed,
+// two cards swapped in ordered decks. Only the cards that fit in the fund on their own are drawn.
+// Marked cards keep their slots: cards are only added and removed past the last marked one.
+class RandomMoves
+{
+public:
+    const bool is_ordered;
+    const std::map<signed, char>& card_marks;
+    unsigned first_free_slot{0}; // past the last marked card
+
+    RandomMoves(const Deck& deck, const Cards& cards_, const std::map<signed, char>& card_marks_) :
+        is_ordered(deck.strategy != DeckStrategy::random),
+        card_marks(card_marks_),
+        cards(cards_)
+    {
+        Deck probe(deck);
+        probe.cards.clear();
+        for(const Card* commander: cards.player_commanders)
+        {
+            probe.commander = commander;
+            if(get_deck_cost(&probe, cards) <= fund) { commanders.push_back(commander); }
+        }
+        probe.commander = deck.commander;
+        unsigned commander_cost(get_deck_cost(&probe, cards));
+        for(auto pool: {&cards.player_assaults, &cards.player_structures, &cards.player_actions})
+        {
+            for(const Card* card: *pool)
+            {
+                probe.cards = {card};
+                if(suitable_non_commander(probe, 0, card) && get_deck_cost(&probe, cards) <= fund + commander_cost) { non_commanders.push_back(card); }
+            }
+        }
+        for(auto& mark: card_marks)
+        {
+            if(mark.first >= 0) { first_free_slot = std::max<unsigned>(first_free_slot, mark.first + 1); }
+        }
+    }
+
+    // A random neighbour of current, false if the move drawn doesn't apply or the deck costs more than the fund.
+    bool propose(const Deck& current, Deck& deck, std::mt19937& re) const
+    {
+        deck = current;
+        unsigned size(deck.cards.size());
+        switch(random_below(is_ordered ? 5 : 4, re))
+        {
+        case 0: {
+            if(card_marks.count(-1) || commanders.empty()) { return(false); }
+            const Card* commander(commanders[random_below(commanders.size(), re)]);
+            if(commander->m_name == deck.commander->m_name) { return(false); }
+            deck.commander = commander;
+            break;
+        }
+        case 1: {
+            if(size == 0 || non_commanders.empty()) { return(false); }
+            unsigned slot(random_below(size, re));
+            const Card* card(non_commanders[random_below(non_commanders.size(), re)]);
+            if(card_marks.count(slot) || card->m_name == deck.cards[slot]->m_name) { return(false); }
+            deck.cards[slot] = card;
+            break;
+        }
+        case 2: {
+            if(size >= max_deck_len || non_commanders.empty()) { return(false); }
+            unsigned slot(is_ordered ? std::max(first_free_slot, size) - random_below(safe_minus(size, first_free_slot) + 1, re) : size);
+            deck.cards.insert(deck.cards.begin() + slot, non_commanders[random_below(non_commanders.size(), re)]);
+            break;
+        }
+        case 3: {
+            if(size <= min_deck_len || size <= first_free_slot) { return(false); }
+            deck.cards.erase(deck.cards.begin() + first_free_slot + random_below(size - first_free_slot, re));
+            break;
+        }
+        case 4: {
+            if(size < 2) { return(false); }
+            unsigned slot1(random_below(size, re)), slot2(random_below(size, re));
+            if(card_marks.count(slot1) || card_marks.count(slot2) || deck.cards[slot1]->m_name == deck.cards[slot2]->m_name) { return(false); }
+            std::swap(deck.cards[slot1], deck.cards[slot2]);
+            break;
+        }
+        }
+        return(get_deck_cost(&deck, cards) <= fund);
+    }
+
+    static unsigned random_below(unsigned n, std::mt19937& re)
+    {
+        return(std::uniform_int_distribution<unsigned>(0, n - 1)(re));
+    }
+
+private:
+    const Cards& cards;
+    std::vector<const Card*> commanders;
+    std::vector<const Card*> non_commanders;
+};
+//------------------------------------------------------------------------------
+// climb -starts <num>: climbs from the attack deck and from random changes of it (see RandomMoves), each with its own
+// shuffles of the cards, one slot of each in turn. Every deck is played once for all of them (Process::keep_results).
+// A climb that swept all its slots and whose best deck is significantly worse than the best deck of all is abandoned.
+void climb_from_starts(unsigned num_starts, unsigned num_iterations, Deck* d1, Process& proc, const std::map<signed, char>& card_marks)
+{
+    std::vector<std::unique_ptr<ClimbTrajectory>> climbs;
+    climbs.emplace_back(new ClimbTrajectory(num_iterations, *d1, proc, card_marks, 0, num_starts > 1 ? "Start 1: " : ""));
+    if(num_starts > 1)
+    {
+        proc.keep_results = proc.results_cache == nullptr;
+        RandomMoves moves(*d1, proc.cards, card_marks);
+        std::mt19937 re(sim_seed);
+        for(unsigned k(1); k < num_starts; ++k)
+        {
+            Deck deck(*d1);
+            // a few changes of the attack deck
+            for(unsigned num_moves(1 + RandomMoves::random_below(std::max<unsigned>(1, d1->cards.size()), re)), attempt(0); num_moves > 0 && attempt < 100; ++attempt)
+            {
+                Deck next;
+                if(moves.propose(deck, next, re)) { deck = next; -- num_moves; }
+            }
+            climbs.emplace_back(new ClimbTrajectory(num_iterations, deck, proc, card_marks, k, "Start " + std::to_string(k + 1) + ": "));
+        }
+    }
+    const ClimbTrajectory* best(climbs[0].get());
+    for(bool stepped(true); stepped; )
+    {
+        stepped = false;
+        for(auto& climb: climbs)
+        {
+            if(climb->done() || best->best_score.points - target_score >= -1e-9) { continue; }
+            climb->step(proc);
+            stepped = true;
+            if(climb->best_score.points > best->best_score.points) { best = climb.get(); }
+            if(climb.get() != best && climb->num_steps > climb->best_cards.size() &&
+                compare_decision(climb->best_results.first, climb->best_results.second, proc.factors, best->best_score.points) == CompareDecision::reject)
+            {
+                climb->abandoned = true;
+                std::cout << climb->name << "Abandoned, significantly worse than the best deck " << deck_hash(best->best_commander, best->best_cards, best->is_ordered) << std::endl;
+            }
+        }
+    }
+    for(auto& climb: climbs) { climb->print_evaluated(); }
+    d1->commander = best->best_commander;
+    d1->cards = best->best_cards;
+    std::cout << "Optimized Deck: ";
+    print_deck_inline(get_deck_cost(d1, proc.cards), best->best_score, best->best_commander, best->best_cards, best->is_ordered);
+}
+//------------------------------------------------------------------------------
+// Simulated annealing: every round proposes random neighbours of the current deck (see RandomMoves), one per thread,
+// and moves to the best one that beats the score of the current deck plus temperature * log(u), u uniform in (0, 1]
+// (Metropolis rule): compare() then stops early on the proposals that can't pass.
+// The temperature cools geometrically over anneal_rounds rounds.
+// A deck proposed again reuses its battles (Process::keep_results): evaluated_decks counts every deck once.
+void simulated_annealing(unsigned num_iterations, Deck* d1, Process& proc, const std::map<signed, char>& card_marks)
+{
+    bool is_ordered(d1->strategy != DeckStrategy::random);
+    proc.keep_results = proc.results_cache == nullptr;
+    auto results = proc.evaluate_cached(num_iterations, proc.att_deck);
+    proc.use_last_as_reference();
+    print_score_info(results, proc.factors);
+    auto current_score = compute_score(results, proc.factors);
+    auto best_score = current_score;
+    auto current_results = results;
+    DeckMemo evaluated_decks(is_ordered);
+    evaluated_decks[evaluated_decks.key(*d1)] = num_iterations;
+    unsigned deck_cost = get_deck_cost(d1, proc.cards);
+    fund = std::max(fund, deck_cost);
+    print_deck_inline(deck_cost, best_score, d1->commander, d1->cards, is_ordered);
+    RandomMoves moves(*d1, proc.cards, card_marks);
+    std::mt19937 re(sim_seed);
+    Deck current(*d1);
+    const Card* best_commander = d1->commander;
+    std::vector<const Card*> best_cards = d1->cards;
+    unsigned num_proposals(std::max(1u, proc.num_threads));
+    for(unsigned round(0); round < anneal_rounds && best_score.points - target_score < -1e-9; ++round)
+    {
+        long double temperature(best_possible_points() / 100 * anneal_temperatures.first *
+            pow(anneal_temperatures.second / anneal_temperatures.first, anneal_rounds > 1 ? (long double)round / (anneal_rounds - 1) : 1));
+        std::vector<Deck> candidate_decks;
+        std::set<uint64_t> proposed{evaluated_decks.key(current)};
+        Deck deck;
+        for(unsigned attempt(0); candidate_decks.size() < num_proposals && attempt < 100 * num_proposals; ++attempt)
+        {
+            if(moves.propose(current, deck, re) && proposed.insert(evaluated_decks.key(deck)).second)
+            {
+                candidate_decks.emplace_back(deck);
+            }
+        }
+        auto threshold(current_score);
+        threshold.points += temperature * log(1 - std::generate_canonical<long double, 64>(re));
+        // crn mode: the reference is the current deck, the proposals have to beat it by temperature * log(u).
+        proc.paired_margin = threshold.points - current_score.points;
+        auto best_index = select_best_candidate(num_iterations, proc, candidate_decks, evaluated_decks, threshold, current_results);
+        proc.paired_margin = 0;
+        if(best_index == candidate_decks.size()) { continue; }
+        current = candidate_decks[best_index];
+        current_score = threshold;
+        if(current_score.points > best_score.points)
+        {
+            best_score = current_score;
+            best_commander = current.commander;
+            best_cards = current.cards;
+            std::cout << "Deck improved: " << deck_hash(best_commander, best_cards, is_ordered) << " round " << round << " (temperature " << temperature << "): ";
+            print_score_info(current_results, proc.factors);
+            print_deck_inline(get_deck_cost(&current, proc.cards), best_score, best_commander, best_cards, is_ordered);
+        }
+    }
+    d1->commander = best_commander;
+    d1->cards = best_cards;
+    std::cout << "Evaluated " << evaluated_decks.size() << " decks (" << evaluated_decks.num_battles() << " simulations)." << std::endl;
+    std::cout << "Optimized Deck: ";
+    print_deck_inline(get_deck_cost(d1, proc.cards), best_score, best_commander, best_cards, is_ordered);
+}
+//------------------------------------------------------------------------------
+// Genetic algorithm: a population of decks, the attack deck and random changes of it (see RandomMoves),
+// is evaluated as a whole on the threads, the best ones are kept, and the others replaced by children of parents
+// drawn by tournaments: crossover of the cards slot by slot (one cut in ordered decks) and of the commander,
+// then a random change half of the time. Marked cards are in the same slots in every deck, so the children keep them.
+// The best score of so many decks is biased up (winner's curse): at the end, the best decks play new battles,
+// and the best one on these is the optimized deck.
+void evolve_decks(unsigned num_generations, unsigned num_iterations, Deck* d1, Process& proc, const std::map<signed, char>& card_marks)
+{
+    bool is_ordered(d1->strategy != DeckStrategy::random);
+    unsigned deck_cost = get_deck_cost(d1, proc.cards);
+    fund = std::max(fund, deck_cost);
+    RandomMoves moves(*d1, proc.cards, card_marks);
+    std::mt19937 re(sim_seed);
+    DeckMemo evaluated_decks(is_ordered);
+    std::unordered_map<uint64_t, long double> scores; // of every deck evaluated
+    unsigned num_elites(std::max(1u, population_size / 8));
+    Results<long double> best_score{0, 0, 0, -1, 0, 0};
+    std::vector<Deck> population{*d1};
+    for(unsigned attempt(0); population.size() < population_size && attempt < 100 * population_size; ++attempt)
+    {
+        Deck deck(*d1);
+        // a few changes of the attack deck
+        for(unsigned num_moves(1 + RandomMoves::random_below(std::max<unsigned>(1, d1->cards.size()), re)); num_moves > 0; )
+        {
+            Deck next;
+            if(moves.propose(deck, next, re)) { deck = next; -- num_moves; }
+            else if(++ attempt >= 100 * population_size) { break; }
+        }
+        population.emplace_back(deck);
+    }
+    for(unsigned generation(0); generation < num_generations && best_score.points - target_score < -1e-9; ++generation)
+    {
+        // Evaluate the new decks at once, then rank the population.
+        std::vector<Deck> new_decks;
+        std::set<uint64_t> new_keys;
+        for(const Deck& deck: population)
+        {
+            uint64_t key(evaluated_decks.key(deck));
+            if(scores.count(key) == 0 && new_keys.insert(key).second) { new_decks.emplace_back(deck); }
+        }
+        auto results = proc.compare_many(new_decks, num_iterations, 0, false);
+        for(unsigned i(0); i < new_decks.size(); ++i)
+        {
+            uint64_t key(evaluated_decks.key(new_decks[i]));
+            evaluated_decks[key] = results[i].second;
+            auto score = compute_score(results[i], proc.factors);
+            scores[key] = score.points;
+            if(score.points > best_score.points)
+            {
+                best_score = score;
+                *d1 = new_decks[i];
+                if(generation > 0 || i > 0) { std::cout << "Deck improved: " << deck_hash(d1->commander, d1->cards, is_ordered) << " generation " << generation << ": "; }
+                print_score_info(results[i], proc.factors);
+                print_deck_inline(get_deck_cost(d1, proc.cards), best_score, d1->commander, d1->cards, is_ordered);
+            }
+        }
+        std::stable_sort(population.begin(), population.end(), [&](const Deck& a, const Deck& b) { return(scores[evaluated_decks.key(a)] > scores[evaluated_decks.key(b)]); });
+        if(generation + 1 == num_generations) { break; }
+        // The next generation: the elites, then children of the population.
+        auto tournament = [&]() -> const Deck&
+        {
+            unsigned a(RandomMoves::random_below(population.size(), re)), b(RandomMoves::random_below(population.size(), re));
+            return(population[std::min(a, b)]);
+        };
+        std::vector<Deck> next_population(population.begin(), population.begin() + std::min<unsigned>(num_elites, population.size()));
+        std::set<uint64_t> keys;
+        for(const Deck& deck: next_population) { keys.insert(evaluated_decks.key(deck)); }
+        for(unsigned attempt(0); next_population.size() < population_size && attempt < 100 * population_size; ++attempt)
+        {
+            const Deck& mother(tournament());
+            const Deck& father(tournament());
+            Deck child(mother);
+            if(!card_marks.count(-1) && RandomMoves::random_below(2, re)) { child.commander = father.commander; }
+            if(is_ordered)
+            {
+                unsigned cut(RandomMoves::random_below(std::min(mother.cards.size(), father.cards.size()) + 1, re));
+                child.cards.assign(mother.cards.begin(), mother.cards.begin() + cut);
+                child.cards.insert(child.cards.end(), father.cards.begin() + cut, father.cards.end());
+            }
+            else
+            {
+                child.cards.clear();
+                for(unsigned slot(0); slot < std::max(mother.cards.size(), father.cards.size()); ++slot)
+                {
+                    const Deck& parent(RandomMoves::random_below(2, re) ? father : mother);
+                    if(slot < parent.cards.size()) { child.cards.push_back(parent.cards[slot]); }
+                }
+            }
+            Deck mutant;
+            if(RandomMoves::random_below(2, re) && moves.propose(child, mutant, re)) { child = mutant; }
+            if(child.cards.size() < min_deck_len || child.cards.size() > max_deck_len || get_deck_cost(&child, proc.cards) > fund) { continue; }
+            if(!keys.insert(evaluated_decks.key(child)).second) { continue; }
+            next_population.emplace_back(child);
+        }
+        population = next_population;
+    }
+    // The best decks evaluated, the elites first when the target score ended the generations early.
+    std::vector<const Deck*> finalists;
+    std::set<uint64_t> finalist_keys;
+    for(const Deck& deck: population)
+    {
+        uint64_t key(evaluated_decks.key(deck));
+        if(finalists.size() < num_elites && scores.count(key) && finalist_keys.insert(key).second) { finalists.push_back(&deck); }
+    }
+    // past the battles of the generations (and of the results cache, see Process::distribute()).
+    std::cout << "Re-evaluating the best " << finalists.size() << " decks with new battles:" << std::endl;
+    auto results = proc.evaluate_many(finalists, num_iterations, num_iterations);
+    best_score = Results<long double>{0, 0, 0, -1, 0, 0};
+    for(unsigned i(0); i < finalists.size(); ++i)
+    {
+        evaluated_decks[evaluated_decks.key(*finalists[i])] += results[i].second;
+        auto score = compute_score(results[i], proc.factors);
+        print_score_info(results[i], proc.factors);
+        print_deck_inline(get_deck_cost(finalists[i], proc.cards), score, finalists[i]->commander, finalists[i]->cards, is_ordered);
+        if(score.points > best_score.points)
+        {
+            best_score = score;
+            *d1 = *finalists[i];
+        }
     }
-    unsigned simulations = 0;
-    for(auto evaluation: evaluated_decks)
-    { simulations += evaluation.second; }
-    std::cout << "Evaluated " << evaluated_decks.size() << " decks (" << simulations << " + " << skipped_simulations << " simulations)." << std::endl;
+    std::cout << "Evaluated " << evaluated_decks.size() << " decks (" << evaluated_decks.num_battles() << " simulations)." << std::endl;
     std::cout << "Optimized Deck: ";
-    print_deck_inline(get_deck_cost(d1, proc.cards), best_score, best_commander, best_cards, true);
+    print_deck_inline(get_deck_cost(d1, proc.cards), best_score, d1->commander, d1->cards, is_ordered);
 }
 //------------------------------------------------------------------------------
 // Implements iteration over all combination of k elements from n elements.
@@ -1088,10 +2412,38 @@ enum Operation {
     simulate,
     climb,
     reorder,
+    anneal,
+    evolve,
+    bench,
     debug,
     debuguntil
 };
 //------------------------------------------------------------------------------
+// Operation taking a number of battles: either <num>, or ci=<num>[%] to play until the 95% confidence interval
+// of the score is within +/- <num>. <num>% is negated until the best possible score is known (see main()),
+// and an invalid <num> is NaN.
+std::tuple<unsigned, unsigned, Operation, long double> make_battles_op(const char* arg, Operation operation)
+{
+    if(strncmp(arg, "ci=", 3) == 0)
+    {
+        char* end;
+        long double half_width(strtold(arg + 3, &end));
+        bool in_percent(*end == '%');
+        if(end == arg + 3 || *(end + in_percent) != '\0' || !(half_width > 0)) { half_width = NAN; }
+        return(std::make_tuple(0u, 0u, operation, in_percent ? -half_width : half_width));
+    }
+    return(std::make_tuple((unsigned)atoi(arg), 0u, operation, 0.0L));
+}
+//------------------------------------------------------------------------------
+// Battles to evaluate every deck with: given, or enough for the confidence interval of the score of the attack deck.
+unsigned num_iterations_for(const std::tuple<unsigned, unsigned, Operation, long double>& op, Process& proc)
+{
+    if(std::get<3>(op) <= 0) { return(std::get<0>(op)); }
+    auto results = proc.evaluate_ci(std::get<3>(op));
+    std::cout << "Battles per deck for +/- " << std::get<3>(op) << " score: " << results.second << std::endl;
+    return(results.second);
+}
+//------------------------------------------------------------------------------
 void print_available_decks(const Decks& decks, bool allow_card_pool)
 {
     std::cout << "Available decks: (use double-quoted name)" << std::endl;
@@ -1115,6 +2467,27 @@ void print_available_effects()
     }
 }
 
+//------------------------------------------------------------------------------
+extern std::string card_description(const Cards& cards, const Card* c);
+// What the battles depend on besides the attack deck: the results cache only mixes the battles played in the same context.
+std::string results_context(const Cards& cards, const std::vector<Deck*>& def_decks, enum Effect effect, const Achievement& achievement)
+{
+    std::stringstream context;
+    context << TU_OPTIMIZER_VERSION << ' ' << engine_version << ' ' << gamemode << ' ' << static_cast<unsigned>(optimization_mode) << ' '
+        << turn_limit << ' ' << effect << ' ' << achievement.id << '\n';
+    for(const Card* card: cards.cards)
+    {
+        context << card_description(cards, card) << '\n';
+    }
+    for(const Deck* def_deck: def_decks)
+    {
+        context << def_deck->strategy << ' ' << (def_deck->fortress1 ? def_deck->fortress1->m_id : 0) << ' ' << (def_deck->fortress2 ? def_deck->fortress2->m_id : 0);
+        for(unsigned id: def_deck->given_hand) { context << ',' << id; }
+        context << '\n' << def_deck->long_description(cards);
+    }
+    return(context.str());
+}
+
 void usage(int argc, char** argv)
 {
     std::cout << "Tyrant Unleashed Optimizer " << TU_OPTIMIZER_VERSION << " - Copyright (C) 2014 zachanassian\nusage: " << argv[0] << " Your_Deck Enemy_Deck [Mode] [Order] [Flags] [Operations]\n"
@@ -1149,6 +2522,10 @@ void usage(int argc, char** argv)
         "               use \"tu_optimize Po Po -e list\" to get a list of all available effects.\n" 
         "  -t <num>: set the number of threads, default is 4.\n"
         "  -turnlimit <num>: set the number of turns in a battle, default is 50.\n"
+        "  -seed <num>: set the random seed. Results are reproducible whatever the number of threads. Default is the current time.\n"
+        "  -cache <file>: keep the results of the battles in <file> across runs. sim, climb and reorder add new battles to the ones a deck already played against the same enemy decks, mode and effect instead of playing them again. <file>.lock keeps other runs from using it meanwhile.\n"
+        "  -rng <engine>: random engine of the battles: splitmix64 [default], xoshiro256, or mt19937 (the generator of former versions, slower; the battles still differ from theirs).\n"
+        "  +strat: with several enemy decks, play each one in a share of the battles proportional to its weight times the spread of its results, instead of in every battle.\n"
         "  -v: less verbose output. Omits output about your and enemy's deck and fortress.\n"
         //"  raid:    simulate/optimize for average raid damage (ARD). default for raids.\n"
         "Flags for climb:\n"
@@ -1168,12 +2545,25 @@ void usage(int argc, char** argv)
         "                -C=\"Commander Sheppard, Legendary Raider 100HP, rally all 3; Gremlin, common bloodthirsty 1/3/0, berserk 1, leech 1\"\n"
         //"  fund <num>: fund <num> gold to buy/upgrade cards. prices are specified in ownedcards file.\n"
         "  target <num>: stop as soon as the score reaches <num>.\n"
+        "  +crn: evaluate every deck on the same random battles and reject a deck as soon as it is significantly worse than the best deck on those battles.\n"
+        "  +race: evaluate the candidates for a slot by racing: a few battles for every candidate, then twice as many for the better half, and so on until one is left.\n"
+        "  -stop <rule>: how to stop evaluating a deck early. rule: sprt (sequential probability ratio test) [default], bayes (posterior probability of beating the best deck) or binomial (reject only).\n"
+        "  -alpha <num>: chance to wrongly reject a better deck when stopping early, default is 0.01.\n"
+        "  -beta <num>: chance to wrongly accept a worse deck when stopping early, default is 0.01.\n"
+        "  -temp <start> <end>: temperatures of anneal at the first and last rounds, in % of the best possible score, default is 2 0.05.\n"
+        "  -rounds <num>: number of rounds of anneal, default is 200. Every round proposes one deck per thread.\n"
+        "  -population <num>: number of decks of evolve, default is 32.\n"
+        "  -starts <num>: number of climbs of climb, default is 1: from the attack deck and from random changes of it, one slot of each in turn. They share the decks evaluated, and a climb significantly worse than the best one is abandoned.\n"
         //"  -u: don't upgrade owned cards. (by default, upgrade owned cards when needed)\n"
         "\n"
         "Operations:\n"
         "  sim <num>: simulate <num> battles to evaluate a deck.\n"
+        "      <num> can also be ci=<num>[%] (e.g. ci=0.5%) for sim, climb, reorder and anneal: simulate until the 95% confidence interval of the score is within +/- <num>, or <num>% of the best possible score (100, 250 in raids, 79 in gw-abp). climb, reorder and anneal start with as many battles per deck as the attack deck needed, and raise it as the best deck needs more.\n"
         "  climb <num>: perform hill-climbing starting from the given attack deck, using up to <num> battles to evaluate a deck.\n"
         "  reorder <num>: optimize the order for given attack deck, using up to <num> battles to evaluate an order.\n"
+        "  anneal <num>: perform simulated annealing starting from the given attack deck, using up to <num> battles to evaluate a deck. Unlike climb, it moves to worse decks at times, less and less often, to get out of local optima. Takes the flags for climb.\n"
+        "  evolve <generations> [<num>]: evolve a population of decks from the given attack deck for <generations> generations, using <num> battles to evaluate a deck (default is 1000). The best decks then play <num> new battles each, the best one on these wins. Takes the flags for climb.\n"
+        "  bench <num>: simulate <num> battles with each random engine, and print the battles per second.\n"
 #ifndef NDEBUG
         "  debug: testing purpose only. very verbose output. only one battle.\n"
         "  debuguntil <min> <max>: testing purpose only. fight until the last fight results in range [<min>, <max>]. recommend to redirect output.\n"
@@ -1192,9 +2582,11 @@ int main(int argc, char** argv)
         return(0);
     }
     unsigned num_threads = 4;
+    sim_seed = time(0);
     DeckStrategy::DeckStrategy att_strategy(DeckStrategy::random);
     DeckStrategy::DeckStrategy def_strategy(DeckStrategy::random);
     bool implicit_ownedcards(true);
+    std::string cache_filename;
     Cards cards;
     read_cards(cards);
     read_card_abbrs(cards, "data/cardabbrs.txt");
@@ -1250,7 +2642,9 @@ int main(int argc, char** argv)
     enum Effect effect(Effect::none);
     bool keep_commander{false};
     bool fixed_len{false};
-    std::vector<std::tuple<unsigned, unsigned, Operation>> todo;
+    // num battles (or min score for debuguntil), max score for debuguntil, operation,
+    // and the target half-width of the confidence interval of the score when the battles are given by ci=<num>
+    std::vector<std::tuple<unsigned, unsigned, Operation, long double>> todo;
 
     try
     {
@@ -1414,6 +2808,31 @@ int main(int argc, char** argv)
             max_deck_len = atoi(argv[argIndex + 2]);
             argIndex += 2;
         }
+        else if(strcmp(argv[argIndex], "-temp") == 0)
+        {
+            anneal_temperatures = std::make_pair(atof(argv[argIndex + 1]), atof(argv[argIndex + 2]));
+            if(anneal_temperatures.first <= 0 || anneal_temperatures.second <= 0)
+            {
+                std::cerr << "Error: the temperatures of -temp must be positive.\n";
+                return(0);
+            }
+            argIndex += 2;
+        }
+        else if(strcmp(argv[argIndex], "-rounds") == 0)
+        {
+            anneal_rounds = atoi(argv[argIndex + 1]);
+            argIndex += 1;
+        }
+        else if(strcmp(argv[argIndex], "-starts") == 0)
+        {
+            climb_starts = std::max(1, atoi(argv[argIndex + 1]));
+            argIndex += 1;
+        }
+        else if(strcmp(argv[argIndex], "-population") == 0)
+        {
+            population_size = std::max(2, atoi(argv[argIndex + 1]));
+            argIndex += 1;
+        }
         else if(strcmp(argv[argIndex], "-o") == 0)
         {
             read_owned_cards(cards, owned_cards, buyable_cards, "data/ownedcards.txt");
@@ -1481,6 +2900,16 @@ int main(int argc, char** argv)
             num_threads = atoi(argv[argIndex+1]);
             argIndex += 1;
         }
+        else if(strcmp(argv[argIndex], "-seed") == 0)
+        {
+            sim_seed = strtoull(argv[argIndex+1], nullptr, 10);
+            argIndex += 1;
+        }
+        else if(strcmp(argv[argIndex], "-cache") == 0)
+        {
+            cache_filename = argv[argIndex+1];
+            argIndex += 1;
+        }
         else if(strcmp(argv[argIndex], "target") == 0)
         {
             target_score = atof(argv[argIndex+1]);
@@ -1503,6 +2932,51 @@ int main(int argc, char** argv)
         {
             use_harmonic_mean = true;
         }
+        else if(strcmp(argv[argIndex], "+crn") == 0)
+        {
+            use_crn = true;
+        }
+        else if(strcmp(argv[argIndex], "-rng") == 0)
+        {
+            auto kind = std::find(rng_names, rng_names + RandomEngine::num_kinds, argv[argIndex + 1]) - rng_names;
+            if(kind == RandomEngine::num_kinds)
+            {
+                std::cerr << "Error: unknown random engine " << argv[argIndex + 1] << ". Use splitmix64, xoshiro256 or mt19937.\n";
+                return(0);
+            }
+            RandomEngine::kind = static_cast<RandomEngine::Kind>(kind);
+            argIndex += 1;
+        }
+        else if(strcmp(argv[argIndex], "+strat") == 0)
+        {
+            use_stratified = true;
+        }
+        else if(strcmp(argv[argIndex], "+race") == 0)
+        {
+            use_racing = true;
+        }
+        else if(strcmp(argv[argIndex], "-stop") == 0)
+        {
+            if(strcmp(argv[argIndex+1], "binomial") == 0) { stop_rule = StopRule::binomial; }
+            else if(strcmp(argv[argIndex+1], "sprt") == 0) { stop_rule = StopRule::sprt; }
+            else if(strcmp(argv[argIndex+1], "bayes") == 0) { stop_rule = StopRule::bayes; }
+            else
+            {
+                std::cerr << "Error: unknown stopping rule " << argv[argIndex+1] << ". Use binomial, sprt or bayes.\n";
+                return(0);
+            }
+            argIndex += 1;
+        }
+        else if(strcmp(argv[argIndex], "-alpha") == 0)
+        {
+            stop_alpha = atof(argv[argIndex+1]);
+            argIndex += 1;
+        }
+        else if(strcmp(argv[argIndex], "-beta") == 0)
+        {
+            stop_beta = atof(argv[argIndex+1]);
+            argIndex += 1;
+        }
         else if(strcmp(argv[argIndex], "+v") == 0)
         {
             ++ debug_print;
@@ -1526,7 +3000,7 @@ int main(int argc, char** argv)
         }
         else if(strcmp(argv[argIndex], "sim") == 0)
         {
-            todo.push_back(std::make_tuple((unsigned)atoi(argv[argIndex + 1]), 0u, simulate));
+            todo.push_back(make_battles_op(argv[argIndex + 1], simulate));
             argIndex += 1;
         }
         else if(strcmp(argv[argIndex], "climb") == 0)
@@ -1536,23 +3010,57 @@ int main(int argc, char** argv)
               read_owned_cards(cards, owned_cards, buyable_cards, "data/ownedcards.txt");
               use_owned_cards = true;
             }
-            todo.push_back(std::make_tuple((unsigned)atoi(argv[argIndex + 1]), 0u, climb));
+            todo.push_back(make_battles_op(argv[argIndex + 1], climb));
+            argIndex += 1;
+        }
+        else if(strcmp(argv[argIndex], "anneal") == 0)
+        {
+            if(implicit_ownedcards)
+            {
+              read_owned_cards(cards, owned_cards, buyable_cards, "data/ownedcards.txt");
+              use_owned_cards = true;
+            }
+            todo.push_back(make_battles_op(argv[argIndex + 1], anneal));
             argIndex += 1;
         }
+        else if(strcmp(argv[argIndex], "evolve") == 0)
+        {
+            if(implicit_ownedcards)
+            {
+              read_owned_cards(cards, owned_cards, buyable_cards, "data/ownedcards.txt");
+              use_owned_cards = true;
+            }
+            if(argIndex + 1 >= argc)
+            {
+                std::cerr << "Error: evolve needs a number of generations.\n";
+                return(0);
+            }
+            // <num> is optional: the next argument may be a flag.
+            bool has_num(argIndex + 2 < argc && (isdigit(argv[argIndex + 2][0]) || strncmp(argv[argIndex + 2], "ci=", 3) == 0));
+            auto op(make_battles_op(has_num ? argv[argIndex + 2] : default_evolve_battles, evolve));
+            std::get<1>(op) = std::max(1, atoi(argv[argIndex + 1]));
+            todo.push_back(op);
+            argIndex += has_num ? 2 : 1;
+        }
         else if(strcmp(argv[argIndex], "reorder") == 0)
         {
-            todo.push_back(std::make_tuple((unsigned)atoi(argv[argIndex + 1]), 0u, reorder));
+            todo.push_back(make_battles_op(argv[argIndex + 1], reorder));
+            argIndex += 1;
+        }
+        else if(strcmp(argv[argIndex], "bench") == 0)
+        {
+            todo.push_back(std::make_tuple((unsigned)atoi(argv[argIndex + 1]), 0u, bench, 0.0L));
             argIndex += 1;
         }
         else if(strcmp(argv[argIndex], "debug") == 0)
         {
-            todo.push_back(std::make_tuple(0u, 0u, debug));
+            todo.push_back(std::make_tuple(0u, 0u, debug, 0.0L));
         }
         else if(strcmp(argv[argIndex], "debuguntil") == 0)
         {
             // output the debug info for the first battle that min_score <= score <= max_score.
             // E.g., 0 0: lose; 100 100: win (non-raid); 150 250: at least 150 damage (raid).
-            todo.push_back(std::make_tuple((unsigned)atoi(argv[argIndex + 1]), (unsigned)atoi(argv[argIndex + 2]), debuguntil));
+            todo.push_back(std::make_tuple((unsigned)atoi(argv[argIndex + 1]), (unsigned)atoi(argv[argIndex + 2]), debuguntil, 0.0L));
             argIndex += 2;
         }
         else if(strcmp(argv[argIndex], "yfort") == 0 || strcmp(argv[argIndex], "yf") == 0)
@@ -1632,6 +3140,18 @@ int main(int argc, char** argv)
             return(0);
         }
     }
+    for(auto& op: todo)
+    {
+        if(std::isnan(std::get<3>(op)))
+        {
+            std::cerr << "Error: ci=<num>[%] needs a positive number.\n";
+            return(0);
+        }
+        // ci=<num>%: in % of the best possible score, known once all the arguments are read.
+        if(std::get<3>(op) < 0) { std::get<3>(op) *= -best_possible_points() / 100; }
+    }
+    stop_z_alpha = boost::math::quantile(boost::math::normal_distribution<long double>(), 1 - stop_alpha);
+    stop_z_beta = boost::math::quantile(boost::math::normal_distribution<long double>(), 1 - stop_beta);
 
     // Force to claim non-buyable cards in your initial deck.
     if(use_owned_cards)
@@ -1689,7 +3209,30 @@ int main(int argc, char** argv)
         }
     }
 
+    compile_skills(cards, effect);
+    for(auto def_deck: def_decks)
+    {
+        compile_skills(cards, effect != Effect::none ? effect : def_deck->effect);
+    }
+    std::unique_ptr<ResultsCache> results_cache;
+    if(!cache_filename.empty())
+    {
+        try
+        {
+            results_cache.reset(new ResultsCache(cache_filename, results_context(cards, def_decks, effect, achievement)));
+        }
+        catch(const std::runtime_error& e)
+        {
+            std::cerr << "Error: " << e.what() << std::endl;
+            return(0);
+        }
+    }
     Process p(num_threads, cards, decks, att_deck, def_decks, def_decks_factors, gamemode, effect, achievement);
+    p.results_cache = results_cache.get();
+    if(use_stratified && def_decks.size() > 1)
+    {
+        p.stratify();
+    }
 
     {
         //ScopeClock timer;
@@ -1698,7 +3241,7 @@ int main(int argc, char** argv)
             switch(std::get<2>(op))
             {
             case simulate: {
-                auto results = p.evaluate(std::get<0>(op));
+                auto results = std::get<3>(op) > 0 ? p.evaluate_ci(std::get<3>(op)) : p.evaluate_cached(std::get<0>(op), p.att_deck);
                 print_results(results, p.factors);
                 break;
             }
@@ -1709,14 +3252,28 @@ int main(int argc, char** argv)
                     std::cerr << "Error: climb not allowed when fortress cards are within a decks card list";
                     return(0);
                 }
-                if(att_strategy == DeckStrategy::random)
+                climb_ci = std::get<3>(op);
+                unsigned num_iterations = num_iterations_for(op, p);
+                climb_from_starts(climb_starts, num_iterations, att_deck, p, att_deck->card_marks);
+                break;
+            }
+            case anneal: {
+                if(att_deck->fortress1 != nullptr && yf_deck == nullptr)
                 {
-                    hill_climbing(std::get<0>(op), att_deck, p, att_deck->card_marks);
+                    std::cerr << "Error: anneal not allowed when fortress cards are within a decks card list";
+                    return(0);
                 }
-                else
+                climb_ci = std::get<3>(op);
+                simulated_annealing(num_iterations_for(op, p), att_deck, p, att_deck->card_marks);
+                break;
+            }
+            case evolve: {
+                if(att_deck->fortress1 != nullptr && yf_deck == nullptr)
                 {
-                    hill_climbing_ordered(std::get<0>(op), att_deck, p, att_deck->card_marks);
+                    std::cerr << "Error: evolve not allowed when fortress cards are within a decks card list";
+                    return(0);
                 }
+                evolve_decks(std::get<1>(op), num_iterations_for(op, p), att_deck, p, att_deck->card_marks);
                 break;
             }
             case reorder: {
@@ -1727,7 +3284,24 @@ int main(int argc, char** argv)
                 owned_cards.clear();
                 claim_cards({att_deck->commander}, cards, true, false);
                 claim_cards(att_deck->cards, cards, true, false);
-                hill_climbing_ordered(std::get<0>(op), att_deck, p, att_deck->card_marks);
+                climb_ci = std::get<3>(op);
+                climb_from_starts(1, num_iterations_for(op, p), att_deck, p, att_deck->card_marks);
+                break;
+            }
+            case bench: {
+                // the same number of battles with each random engine.
+                auto saved_kind = RandomEngine::kind;
+                for(unsigned kind(0); kind < RandomEngine::num_kinds; ++kind)
+                {
+                    RandomEngine::kind = static_cast<RandomEngine::Kind>(kind);
+                    auto start = std::chrono::steady_clock::now();
+                    auto results = p.evaluate(std::get<0>(op));
+                    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+                    uint64_t num_battles(0);
+                    for(auto val: results.first) { num_battles += val.battles; }
+                    std::cout << rng_names[kind] << ": " << num_battles / elapsed.count() << " battles/s, score: " << compute_score(results, p.factors).points << std::endl;
+                }
+                RandomEngine::kind = saved_kind;
                 break;
             }
             case debug: {
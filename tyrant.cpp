@@ -3,6 +3,8 @@
 #include <string>
 
 bool verbose(true);
+RandomEngine::Kind RandomEngine::kind{RandomEngine::splitmix64};
+std::string rng_names[RandomEngine::num_kinds] = {"splitmix64", "xoshiro256", "mt19937"};
 const std::string faction_names[Faction::num_factions] =
 { "", "bloodthirsty", "imperial", "raider", "righteous", "xeno", "progenitor" };
 
@@ -4,6 +4,8 @@
 #define TU_OPTIMIZER_VERSION "3.7.0"
 #define NDEBUG
 
+#include <cstdint>
+#include <random>
 #include <string>
 #include <set>
 #include <tuple>
@@ -205,6 +207,143 @@ enum SkillSourceType
     source_chaos
 };
 
-typedef std::tuple<Skill, unsigned, Faction, bool /* all */, SkillMod::SkillMod> SkillSpec;
+// A skill as a card has it, packed in 8 bytes so that it is cheap to copy through the skill queue.
+struct SkillSpec
+{
+    unsigned value; // x of the skill, or the card id of summon
+    Skill id : 8;
+    Faction faction : 8;
+    bool all : 1;
+    SkillMod::SkillMod mod : 7;
+
+    SkillSpec() {}
+    SkillSpec(Skill id_, unsigned value_, Faction faction_, bool all_, SkillMod::SkillMod mod_) :
+        value(value_),
+        id(id_),
+        faction(faction_),
+        all(all_),
+        mod(mod_)
+    {
+    }
+};
+static_assert(sizeof(SkillSpec) == 8, "SkillSpec is expected to pack in 8 bytes");
+
+// SplitMix64: a counter-based random engine. Seeding it only sets the counter,
+// so every battle can afford its own random stream.
+class SplitMix64
+{
+public:
+    typedef uint64_t result_type;
+    explicit SplitMix64(result_type seed_ = 0) : m_state(seed_) {}
+    void seed(result_type seed_) { m_state = seed_; }
+    static constexpr result_type min() { return(0); }
+    static constexpr result_type max() { return(UINT64_MAX); }
+    inline result_type operator()()
+    {
+        result_type z(m_state += 0x9e3779b97f4a7c15ull);
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+        return(z ^ (z >> 31));
+    }
+private:
+    result_type m_state;
+};
+
+// xoshiro256**: 32 bytes of state, seeded through SplitMix64 as its authors recommend.
+class Xoshiro256
+{
+public:
+    typedef uint64_t result_type;
+    explicit Xoshiro256(result_type seed_ = 0) { seed(seed_); }
+    void seed(result_type seed_)
+    {
+        SplitMix64 sm(seed_);
+        for(auto& word: m_state) { word = sm(); }
+    }
+    static constexpr result_type min() { return(0); }
+    static constexpr result_type max() { return(UINT64_MAX); }
+    inline result_type operator()()
+    {
+        result_type result(rotl(m_state[1] * 5, 7) * 9);
+        result_type t(m_state[1] << 17);
+        m_state[2] ^= m_state[0];
+        m_state[3] ^= m_state[1];
+        m_state[1] ^= m_state[2];
+        m_state[0] ^= m_state[3];
+        m_state[2] ^= t;
+        m_state[3] = rotl(m_state[3], 45);
+        return(result);
+    }
+private:
+    static inline result_type rotl(result_type x, int k) { return((x << k) | (x >> (64 - k))); }
+    result_type m_state[4];
+};
+
+// The random engine of the battles. The generator is chosen at run time (-rng) for all the engines at once;
+// mt19937 is the generator of former versions, but is much slower to seed for every battle. Its battles don't replay
+// the ones of former versions though: every battle has its own seed, and bounded() draws differently.
+class RandomEngine
+{
+public:
+    enum Kind
+    {
+        splitmix64,
+        xoshiro256,
+        mt19937,
+        num_kinds
+    };
+    static Kind kind;
+    typedef uint64_t result_type;
+    explicit RandomEngine(result_type seed_ = 0) { seed(seed_); }
+    void seed(result_type seed_)
+    {
+        switch(kind)
+        {
+        case splitmix64: m_splitmix.seed(seed_); break;
+        case xoshiro256: m_xoshiro.seed(seed_); break;
+        default: m_mt.seed(seed_); break;
+        }
+    }
+    static constexpr result_type min() { return(0); }
+    static constexpr result_type max() { return(UINT64_MAX); }
+    inline result_type operator()()
+    {
+        switch(kind)
+        {
+        case splitmix64: return(m_splitmix());
+        case xoshiro256: return(m_xoshiro());
+        default:
+            {
+                // two draws in this order: the operands of | would be evaluated in any order.
+                result_type high(m_mt());
+                result_type low(m_mt());
+                return((high << 32) | low);
+            }
+        }
+    }
+    // Uniform in [0, n) for n > 0, by Lemire's multiply-shift method: no division but in the rare rejection case.
+    inline uint32_t bounded(uint32_t n)
+    {
+        uint64_t m((uint64_t)random32() * n);
+        if((uint32_t)m < n)
+        {
+            uint32_t threshold((0u - n) % n);
+            while((uint32_t)m < threshold)
+            {
+                m = (uint64_t)random32() * n;
+            }
+        }
+        return(m >> 32);
+    }
+private:
+    inline uint32_t random32()
+    {
+        return(kind == mt19937 ? m_mt() : (*this)() >> 32);
+    }
+    SplitMix64 m_splitmix;
+    Xoshiro256 m_xoshiro;
+    std::mt19937 m_mt;
+};
+extern std::string rng_names[RandomEngine::num_kinds];
 
 #endif
@@ -302,4 +302,13 @@ echo Enemy's Deck: [SoO6iC-BQ-BW-GV-LB-LT] Barracus, Crushing Anvil, Tartarus Br
 echo win%: 83.63 (8353 8373 / 10000)
 echo stall%: 0.48 (44 52 / 10000)
 echo loss%: 15.89 (1603 1575 / 10000)
+echo.
+
+@echo on
+tu_optimize.exe "Cyrus, Bolt Crag(5)" "Barracus, Mephalus Gorge(2), Noble Defiance" -seed 3 +crn sim ci=1
+@echo off
+echo === Expected (the same battles as sim 8845, no battle played twice) ===
+echo win%: 66.8966 (5917 / 8845)
+echo stall%: 0 (0 / 8845)
+echo loss%: 33.1034 (2928 / 8845)
 echo.
\ No newline at end of file